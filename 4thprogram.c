@@ -0,0 +1,4100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Reference validator from 1stprogram.c (min_length 2) and 2ndprogram.c
+   (min_length 3): a string of 'a's followed by "bb". */
+int pattern2(const char *string, int length, int min_length)
+{
+  if (length < min_length)
+  {
+    return 0;
+  }
+  if (string[length - 1] != 'b' || string[length - 2] != 'b')
+  {
+    return 0;
+  }
+
+  for (int i = 0; i < length - 2; i++)
+  {
+    if (string[i] != 'a')
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Deterministic counter and pushdown automata.
+
+   Each byte is mapped to a class, and (state, class) selects one
+   transition. A transition can check the height (the counter, or the
+   stack depth) before firing, and then changes it: OP_ADD adds a
+   signed delta to the counter, OP_PUSH pushes a stack symbol, and
+   OP_POP pops one that must match. A string is accepted when it ends
+   in an accepting state with height zero. Runs keep the first
+   AUTOMATON_STACK_DEPTH symbols inline and only allocate when a deeper
+   stack is needed; automaton_release frees it. */
+
+#define AUTOMATON_MAX_STATES 8
+#define AUTOMATON_MAX_CLASSES 8
+#define AUTOMATON_STACK_DEPTH 1024
+#define AUTOMATON_REJECT 0xff
+
+enum
+{
+  OP_NONE,
+  OP_ADD,
+  OP_PUSH,
+  OP_POP
+};
+
+enum
+{
+  GUARD_ANY,
+  GUARD_ZERO,
+  GUARD_NONZERO
+};
+
+typedef struct
+{
+  unsigned char next;
+  unsigned char op;
+  signed char arg;
+  unsigned char guard;
+} Transition;
+
+typedef struct
+{
+  const char *name;
+  unsigned char byte_class[256];
+  Transition table[AUTOMATON_MAX_STATES][AUTOMATON_MAX_CLASSES];
+  unsigned char accepting[AUTOMATON_MAX_STATES];
+} Automaton;
+
+typedef struct
+{
+  int state;
+  long counter;
+  int depth;
+  int capacity;
+  signed char *stack; /* inline_stack, or a heap copy once it outgrows it */
+  signed char inline_stack[AUTOMATON_STACK_DEPTH];
+} AutomatonRun;
+
+void automaton_begin(AutomatonRun *run)
+{
+  run->state = 0;
+  run->counter = 0;
+  run->depth = 0;
+  run->capacity = AUTOMATON_STACK_DEPTH;
+  run->stack = run->inline_stack;
+}
+
+void automaton_release(AutomatonRun *run)
+{
+  if (run->stack != run->inline_stack)
+  {
+    free(run->stack);
+  }
+  run->stack = run->inline_stack;
+  run->capacity = AUTOMATON_STACK_DEPTH;
+}
+
+/* Double the stack, moving it to the heap the first time. */
+static void automaton_grow(AutomatonRun *run)
+{
+  int capacity = run->capacity * 2;
+  signed char *stack = run->stack == run->inline_stack ? NULL : run->stack;
+
+  stack = realloc(stack, capacity);
+  if (run->stack == run->inline_stack)
+  {
+    memcpy(stack, run->inline_stack, run->capacity);
+  }
+  run->stack = stack;
+  run->capacity = capacity;
+}
+
+/* Feed a chunk; returns 0 once the run can no longer accept. */
+int automaton_feed(const Automaton *automaton, AutomatonRun *run, const char *chunk, size_t length)
+{
+  int state = run->state;
+  long counter = run->counter;
+  int depth = run->depth;
+
+  for (size_t i = 0; i < length && state != AUTOMATON_REJECT; i++)
+  {
+    const Transition *t = &automaton->table[state][automaton->byte_class[(unsigned char)chunk[i]]];
+    long height = counter + depth;
+
+    if ((t->guard == GUARD_ZERO && height != 0) || (t->guard == GUARD_NONZERO && height == 0))
+    {
+      state = AUTOMATON_REJECT;
+      break;
+    }
+    switch (t->op)
+    {
+    case OP_ADD:
+      counter += t->arg;
+      if (counter < 0)
+      {
+        state = AUTOMATON_REJECT;
+        continue;
+      }
+      break;
+    case OP_PUSH:
+      if (depth == run->capacity)
+      {
+        automaton_grow(run);
+      }
+      run->stack[depth++] = t->arg;
+      break;
+    case OP_POP:
+      if (depth == 0 || run->stack[depth - 1] != t->arg)
+      {
+        state = AUTOMATON_REJECT;
+        continue;
+      }
+      depth--;
+      break;
+    }
+    state = t->next;
+  }
+
+  run->state = state;
+  run->counter = counter;
+  run->depth = depth;
+  return state != AUTOMATON_REJECT;
+}
+
+int automaton_end(const Automaton *automaton, const AutomatonRun *run)
+{
+  return run->state != AUTOMATON_REJECT && automaton->accepting[run->state] &&
+         run->counter == 0 && run->depth == 0;
+}
+
+int automaton_accepts(const Automaton *automaton, const char *string, size_t length)
+{
+  AutomatonRun run;
+  automaton_begin(&run);
+  automaton_feed(automaton, &run, string, length);
+  int accepted = automaton_end(automaton, &run);
+  automaton_release(&run);
+  return accepted;
+}
+
+/* Every (state, class) pair starts out rejecting; every byte starts out
+   in class 0. */
+static void automaton_clear(Automaton *automaton, const char *name)
+{
+  memset(automaton, 0, sizeof(*automaton));
+  automaton->name = name;
+  for (int s = 0; s < AUTOMATON_MAX_STATES; s++)
+  {
+    for (int c = 0; c < AUTOMATON_MAX_CLASSES; c++)
+    {
+      automaton->table[s][c].next = AUTOMATON_REJECT;
+    }
+  }
+}
+
+static void automaton_set(Automaton *automaton, int state, int cls, int next, int op, int arg, int guard)
+{
+  Transition *t = &automaton->table[state][cls];
+  t->next = next;
+  t->op = op;
+  t->arg = arg;
+  t->guard = guard;
+}
+
+/* a^n b^(k*n), n >= 1: each 'a' adds k to the counter and each 'b' takes
+   away 1. Class 1 is 'a' and class 2 is 'b'. */
+static void build_counter_language(Automaton *automaton, const char *name, int k)
+{
+  automaton_clear(automaton, name);
+  automaton->byte_class['a'] = 1;
+  automaton->byte_class['b'] = 2;
+  automaton_set(automaton, 0, 1, 1, OP_ADD, k, GUARD_ANY);
+  automaton_set(automaton, 1, 1, 1, OP_ADD, k, GUARD_ANY);
+  automaton_set(automaton, 1, 2, 2, OP_ADD, -1, GUARD_NONZERO);
+  automaton_set(automaton, 2, 2, 2, OP_ADD, -1, GUARD_NONZERO);
+  automaton->accepting[2] = 1;
+}
+
+/* Balanced (), [] and {} including the empty string; class 1..3 open and
+   class 4..6 close the matching pair. */
+static void build_balanced(Automaton *automaton)
+{
+  const char *open = "([{";
+  const char *close = ")]}";
+
+  automaton_clear(automaton, "balanced");
+  for (int i = 0; i < 3; i++)
+  {
+    automaton->byte_class[(unsigned char)open[i]] = 1 + i;
+    automaton->byte_class[(unsigned char)close[i]] = 4 + i;
+    automaton_set(automaton, 0, 1 + i, 0, OP_PUSH, i, GUARD_ANY);
+    automaton_set(automaton, 0, 4 + i, 0, OP_POP, i, GUARD_NONZERO);
+  }
+  automaton->accepting[0] = 1;
+}
+
+static Automaton anbn_automaton;
+static Automaton anb2n_automaton;
+static Automaton balanced_automaton;
+
+void init_automata(void)
+{
+  build_counter_language(&anbn_automaton, "anbn", 1);
+  build_counter_language(&anb2n_automaton, "anb2n", 2);
+  build_balanced(&balanced_automaton);
+}
+
+/* Regular expressions compiled to table DFAs.
+
+   The syntax is literals, '.', bracket classes such as [a-z] and [^\n],
+   the escapes \d \w \s (and \n \t \r; any other escaped byte is
+   literal), postfix * + ?, alternation | and grouping with (). A pattern
+   must match the whole string. The parser builds a Thompson NFA whose
+   states have one byte-set edge and up to two empty edges; subset
+   construction then turns it into a DFA over byte classes, where bytes
+   that no NFA edge tells apart share a class. DFA state 0 is the dead
+   state and state 1 the start. */
+
+#define REGEX_MAX_NFA 4096
+#define DFA_MAX_STATES 4096
+#define DFA_DEAD 0
+
+typedef struct
+{
+  unsigned char bytes[32];
+  int next;
+  int eps[2];
+} NfaState;
+
+typedef struct
+{
+  NfaState *states;
+  int count;
+  int capacity;
+  int start;
+  int accept;
+} Nfa;
+
+typedef struct
+{
+  int state_count;
+  int class_count;
+  unsigned char byte_class[256];
+  unsigned short *table;
+  unsigned char *accepting;
+} Dfa;
+
+typedef struct
+{
+  int start;
+  int end;
+} NfaFragment;
+
+typedef struct
+{
+  const char *p;
+  Nfa *nfa;
+  char *error;
+  size_t error_size;
+  int failed;
+} RegexParser;
+
+static int nfa_add_state(RegexParser *parser)
+{
+  Nfa *nfa = parser->nfa;
+  if (nfa->count == REGEX_MAX_NFA)
+  {
+    snprintf(parser->error, parser->error_size, "pattern needs more than %d NFA states", REGEX_MAX_NFA);
+    parser->failed = 1;
+    return 0;
+  }
+  if (nfa->count == nfa->capacity)
+  {
+    nfa->capacity = nfa->capacity == 0 ? 64 : nfa->capacity * 2;
+    nfa->states = realloc(nfa->states, nfa->capacity * sizeof(NfaState));
+  }
+  NfaState *state = &nfa->states[nfa->count];
+  memset(state->bytes, 0, sizeof(state->bytes));
+  state->next = -1;
+  state->eps[0] = -1;
+  state->eps[1] = -1;
+  return nfa->count++;
+}
+
+static void nfa_add_eps(Nfa *nfa, int from, int to)
+{
+  NfaState *state = &nfa->states[from];
+  state->eps[state->eps[0] < 0 ? 0 : 1] = to;
+}
+
+static void byte_set_add(unsigned char *set, int byte)
+{
+  set[byte >> 3] |= 1 << (byte & 7);
+}
+
+static int byte_set_has(const unsigned char *set, int byte)
+{
+  return set[byte >> 3] >> (byte & 7) & 1;
+}
+
+/* The byte set of an escape after the backslash at *p; advances *p. */
+static void regex_escape(const char **p, unsigned char *set)
+{
+  char c = **p;
+  if (c != '\0')
+  {
+    (*p)++;
+  }
+  switch (c)
+  {
+  case 'd':
+    for (int b = '0'; b <= '9'; b++)
+    {
+      byte_set_add(set, b);
+    }
+    break;
+  case 'w':
+    for (int b = 0; b < 256; b++)
+    {
+      if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_')
+      {
+        byte_set_add(set, b);
+      }
+    }
+    break;
+  case 's':
+    byte_set_add(set, ' ');
+    for (int b = '\t'; b <= '\r'; b++)
+    {
+      byte_set_add(set, b);
+    }
+    break;
+  case 'n':
+    byte_set_add(set, '\n');
+    break;
+  case 't':
+    byte_set_add(set, '\t');
+    break;
+  case 'r':
+    byte_set_add(set, '\r');
+    break;
+  default:
+    byte_set_add(set, (unsigned char)c);
+    break;
+  }
+}
+
+/* Parse a bracket class after its '['. */
+static int regex_class(RegexParser *parser, unsigned char *set)
+{
+  int negate = *parser->p == '^';
+  parser->p += negate;
+  int first = 1;
+
+  while (*parser->p != ']' || first)
+  {
+    if (*parser->p == '\0')
+    {
+      snprintf(parser->error, parser->error_size, "missing ']'");
+      return 0;
+    }
+    int low = (unsigned char)*parser->p++;
+    if (low == '\\')
+    {
+      unsigned char escaped[32] = {0};
+      regex_escape(&parser->p, escaped);
+      for (int b = 0; b < 32; b++)
+      {
+        set[b] |= escaped[b];
+      }
+      first = 0;
+      continue;
+    }
+    int high = low;
+    if (parser->p[0] == '-' && parser->p[1] != ']' && parser->p[1] != '\0')
+    {
+      high = (unsigned char)parser->p[1];
+      parser->p += 2;
+      if (high < low)
+      {
+        snprintf(parser->error, parser->error_size, "reversed range %c-%c", low, high);
+        return 0;
+      }
+    }
+    for (int b = low; b <= high; b++)
+    {
+      byte_set_add(set, b);
+    }
+    first = 0;
+  }
+  parser->p++;
+  if (negate)
+  {
+    for (int b = 0; b < 32; b++)
+    {
+      set[b] = ~set[b];
+    }
+  }
+  return 1;
+}
+
+static int regex_alternation(RegexParser *parser, NfaFragment *out);
+
+static int regex_atom(RegexParser *parser, NfaFragment *out)
+{
+  char c = *parser->p;
+  if (c == '(')
+  {
+    parser->p++;
+    if (!regex_alternation(parser, out))
+    {
+      return 0;
+    }
+    if (*parser->p != ')')
+    {
+      snprintf(parser->error, parser->error_size, "missing ')'");
+      return 0;
+    }
+    parser->p++;
+    return 1;
+  }
+  if (c == '*' || c == '+' || c == '?')
+  {
+    snprintf(parser->error, parser->error_size, "nothing to repeat before '%c'", c);
+    return 0;
+  }
+
+  out->start = nfa_add_state(parser);
+  out->end = nfa_add_state(parser);
+  if (parser->failed)
+  {
+    return 0;
+  }
+  NfaState *state = &parser->nfa->states[out->start];
+  state->next = out->end;
+  parser->p++;
+  if (c == '.')
+  {
+    memset(state->bytes, 0xff, sizeof(state->bytes));
+  }
+  else if (c == '[')
+  {
+    return regex_class(parser, parser->nfa->states[out->start].bytes);
+  }
+  else if (c == '\\')
+  {
+    regex_escape(&parser->p, state->bytes);
+  }
+  else
+  {
+    byte_set_add(state->bytes, (unsigned char)c);
+  }
+  return 1;
+}
+
+static int regex_repeat(RegexParser *parser, NfaFragment *out)
+{
+  if (!regex_atom(parser, out))
+  {
+    return 0;
+  }
+  while (*parser->p == '*' || *parser->p == '+' || *parser->p == '?')
+  {
+    char op = *parser->p++;
+    int start = nfa_add_state(parser);
+    int end = nfa_add_state(parser);
+    if (parser->failed)
+    {
+      return 0;
+    }
+    nfa_add_eps(parser->nfa, start, out->start);
+    if (op != '+')
+    {
+      nfa_add_eps(parser->nfa, start, end);
+    }
+    if (op != '?')
+    {
+      nfa_add_eps(parser->nfa, out->end, out->start);
+    }
+    nfa_add_eps(parser->nfa, out->end, end);
+    out->start = start;
+    out->end = end;
+  }
+  return 1;
+}
+
+static int regex_concatenation(RegexParser *parser, NfaFragment *out)
+{
+  out->start = nfa_add_state(parser);
+  out->end = out->start;
+  if (parser->failed)
+  {
+    return 0;
+  }
+  while (*parser->p != '\0' && *parser->p != '|' && *parser->p != ')')
+  {
+    NfaFragment next;
+    if (!regex_repeat(parser, &next))
+    {
+      return 0;
+    }
+    nfa_add_eps(parser->nfa, out->end, next.start);
+    out->end = next.end;
+  }
+  return 1;
+}
+
+static int regex_alternation(RegexParser *parser, NfaFragment *out)
+{
+  if (!regex_concatenation(parser, out))
+  {
+    return 0;
+  }
+  while (*parser->p == '|')
+  {
+    parser->p++;
+    NfaFragment right;
+    if (!regex_concatenation(parser, &right))
+    {
+      return 0;
+    }
+    int start = nfa_add_state(parser);
+    int end = nfa_add_state(parser);
+    if (parser->failed)
+    {
+      return 0;
+    }
+    nfa_add_eps(parser->nfa, start, out->start);
+    nfa_add_eps(parser->nfa, start, right.start);
+    nfa_add_eps(parser->nfa, out->end, end);
+    nfa_add_eps(parser->nfa, right.end, end);
+    out->start = start;
+    out->end = end;
+  }
+  return 1;
+}
+
+void nfa_free(Nfa *nfa)
+{
+  free(nfa->states);
+  memset(nfa, 0, sizeof(*nfa));
+}
+
+/* Parse source into a Thompson NFA; on failure returns 0 with a message in
+   error. */
+int regex_parse(const char *source, Nfa *nfa, char *error, size_t error_size)
+{
+  RegexParser parser = {source, nfa, error, error_size, 0};
+  NfaFragment whole;
+
+  memset(nfa, 0, sizeof(*nfa));
+  if (!regex_alternation(&parser, &whole) || *parser.p != '\0')
+  {
+    if (!parser.failed && *parser.p == ')')
+    {
+      snprintf(error, error_size, "unmatched ')'");
+    }
+    nfa_free(nfa);
+    return 0;
+  }
+  nfa->start = whole.start;
+  nfa->accept = whole.end;
+  return 1;
+}
+
+/* Add the states reachable over empty edges from those already in set. */
+static void nfa_closure(const Nfa *nfa, unsigned long *set, int *stack)
+{
+  int depth = 0;
+  for (int s = 0; s < nfa->count; s++)
+  {
+    if (set[s / 64] >> (s % 64) & 1)
+    {
+      stack[depth++] = s;
+    }
+  }
+  while (depth > 0)
+  {
+    const NfaState *state = &nfa->states[stack[--depth]];
+    for (int e = 0; e < 2; e++)
+    {
+      int to = state->eps[e];
+      if (to >= 0 && !(set[to / 64] >> (to % 64) & 1))
+      {
+        set[to / 64] |= 1UL << (to % 64);
+        stack[depth++] = to;
+      }
+    }
+  }
+}
+
+/* Split the bytes into the classes no edge of the NFA tells apart. Returns
+   the class count and a representative byte of each class. */
+static int nfa_byte_classes(const Nfa *nfa, unsigned char *byte_class, unsigned char *representative)
+{
+  int count = 1;
+  memset(byte_class, 0, 256);
+  for (int s = 0; s < nfa->count; s++)
+  {
+    if (nfa->states[s].next < 0)
+    {
+      continue;
+    }
+    /* Refine: (old class, in this set) pairs become the new classes. */
+    int renumber[2][256];
+    memset(renumber, -1, sizeof(renumber));
+    int next_count = 0;
+    for (int b = 0; b < 256; b++)
+    {
+      int in = byte_set_has(nfa->states[s].bytes, b);
+      int *slot = &renumber[in][byte_class[b]];
+      if (*slot < 0)
+      {
+        *slot = next_count++;
+      }
+      byte_class[b] = *slot;
+    }
+    count = next_count;
+  }
+  for (int b = 255; b >= 0; b--)
+  {
+    representative[byte_class[b]] = b;
+  }
+  return count;
+}
+
+void dfa_free(Dfa *dfa)
+{
+  free(dfa->table);
+  free(dfa->accepting);
+  memset(dfa, 0, sizeof(*dfa));
+}
+
+/* Subset construction. DFA states are sets of NFA states, found again
+   through an open-addressing hash of their bitsets. */
+int dfa_build(const Nfa *nfa, Dfa *dfa, char *error, size_t error_size)
+{
+  int words = (nfa->count + 63) / 64;
+  unsigned char representative[256];
+  int capacity = 64;
+  unsigned long *sets = calloc((size_t)capacity * words, sizeof(unsigned long));
+  int slot_count = 2 * DFA_MAX_STATES;
+  int *slots = malloc(slot_count * sizeof(int));
+  int *stack = malloc(nfa->count * sizeof(int));
+  unsigned long *next = malloc(words * sizeof(unsigned long));
+  int ok = 1;
+
+  memset(dfa, 0, sizeof(*dfa));
+  memset(slots, -1, slot_count * sizeof(int));
+  dfa->class_count = nfa_byte_classes(nfa, dfa->byte_class, representative);
+  dfa->table = malloc((size_t)capacity * dfa->class_count * sizeof(unsigned short));
+  dfa->accepting = malloc(capacity);
+
+  /* State 0 is the empty set (dead) and state 1 the start closure. */
+  for (int id = 0; id < 2 && ok; id++)
+  {
+    memset(next, 0, words * sizeof(unsigned long));
+    if (id == 1)
+    {
+      next[nfa->start / 64] |= 1UL << (nfa->start % 64);
+      nfa_closure(nfa, next, stack);
+    }
+    memcpy(sets + (size_t)id * words, next, words * sizeof(unsigned long));
+    unsigned int hash = 2166136261u;
+    for (int w = 0; w < words; w++)
+    {
+      hash = (hash ^ (unsigned int)(next[w] ^ next[w] >> 32)) * 16777619u;
+    }
+    unsigned int slot = hash % slot_count;
+    while (slots[slot] >= 0)
+    {
+      slot = (slot + 1) % slot_count;
+    }
+    slots[slot] = id;
+    dfa->state_count++;
+  }
+
+  for (int d = 0; d < dfa->state_count && ok; d++)
+  {
+    const unsigned long *current = sets + (size_t)d * words;
+    dfa->accepting[d] = current[nfa->accept / 64] >> (nfa->accept % 64) & 1;
+    for (int c = 0; c < dfa->class_count; c++)
+    {
+      memset(next, 0, words * sizeof(unsigned long));
+      for (int s = 0; s < nfa->count; s++)
+      {
+        if ((current[s / 64] >> (s % 64) & 1) && nfa->states[s].next >= 0 &&
+            byte_set_has(nfa->states[s].bytes, representative[c]))
+        {
+          int to = nfa->states[s].next;
+          next[to / 64] |= 1UL << (to % 64);
+        }
+      }
+      nfa_closure(nfa, next, stack);
+
+      unsigned int hash = 2166136261u;
+      for (int w = 0; w < words; w++)
+      {
+        hash = (hash ^ (unsigned int)(next[w] ^ next[w] >> 32)) * 16777619u;
+      }
+      unsigned int slot = hash % slot_count;
+      while (slots[slot] >= 0 &&
+             memcmp(sets + (size_t)slots[slot] * words, next, words * sizeof(unsigned long)) != 0)
+      {
+        slot = (slot + 1) % slot_count;
+      }
+      if (slots[slot] < 0)
+      {
+        if (dfa->state_count == DFA_MAX_STATES)
+        {
+          snprintf(error, error_size, "pattern needs more than %d DFA states", DFA_MAX_STATES);
+          ok = 0;
+          break;
+        }
+        if (dfa->state_count == capacity)
+        {
+          capacity *= 2;
+          sets = realloc(sets, (size_t)capacity * words * sizeof(unsigned long));
+          dfa->table = realloc(dfa->table, (size_t)capacity * dfa->class_count * sizeof(unsigned short));
+          dfa->accepting = realloc(dfa->accepting, capacity);
+          current = sets + (size_t)d * words;
+        }
+        memcpy(sets + (size_t)dfa->state_count * words, next, words * sizeof(unsigned long));
+        slots[slot] = dfa->state_count++;
+      }
+      dfa->table[(size_t)d * dfa->class_count + c] = slots[slot];
+    }
+  }
+
+  free(next);
+  free(stack);
+  free(slots);
+  free(sets);
+  if (!ok)
+  {
+    dfa_free(dfa);
+  }
+  return ok;
+}
+
+/* Parse and build in one step. */
+int dfa_compile(const char *source, Dfa *dfa, char *error, size_t error_size)
+{
+  Nfa nfa;
+  if (!regex_parse(source, &nfa, error, error_size))
+  {
+    return 0;
+  }
+  int ok = dfa_build(&nfa, dfa, error, error_size);
+  nfa_free(&nfa);
+  return ok;
+}
+
+/* The table interpreter: one class lookup and one table load per byte. */
+int dfa_accepts(const Dfa *dfa, const char *string, size_t length)
+{
+  const unsigned char *p = (const unsigned char *)string;
+  const unsigned char *end = p + length;
+  const unsigned short *table = dfa->table;
+  int classes = dfa->class_count;
+  unsigned int state = 1;
+
+  while (p < end)
+  {
+    state = table[state * classes + dfa->byte_class[*p++]];
+    if (state == DFA_DEAD)
+    {
+      return 0;
+    }
+  }
+  return dfa->accepting[state];
+}
+
+/* Native x86-64 code for a DFA.
+
+   The generated function is int match(const unsigned char *s, size_t n)
+   under the System V ABI. Each live state becomes a block that stops at
+   the end of input (returning whether the state accepts), loads the next
+   byte and compares it against the byte ranges leading to each live
+   successor, falling through to reject. There is no table load on the
+   hot path. States with more than DFA_JIT_MAX_RANGES ranges, other
+   architectures, or a failing mmap/mprotect leave match NULL, and
+   callers use the table interpreter instead. */
+
+#define DFA_JIT_MAX_RANGES 64
+
+typedef struct
+{
+  int (*match)(const unsigned char *string, size_t length);
+  void *code;
+  size_t size;
+} DfaJit;
+
+typedef struct
+{
+  unsigned char *code;
+  size_t length;
+  size_t capacity;
+  int *fixups;      /* offsets of rel32 fields to patch */
+  int *fixup_state; /* target block of each fixup, -1 for reject */
+  int fixup_count;
+  int fixup_capacity;
+} JitBuffer;
+
+static void jit_emit(JitBuffer *jit, const void *bytes, size_t length)
+{
+  if (jit->length + length > jit->capacity)
+  {
+    while (jit->length + length > jit->capacity)
+    {
+      jit->capacity = jit->capacity == 0 ? 4096 : jit->capacity * 2;
+    }
+    jit->code = realloc(jit->code, jit->capacity);
+  }
+  memcpy(jit->code + jit->length, bytes, length);
+  jit->length += length;
+}
+
+static void jit_emit_u32(JitBuffer *jit, unsigned int value)
+{
+  unsigned char bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+  jit_emit(jit, bytes, 4);
+}
+
+/* Emit a jump opcode with a rel32 to the block of state target (-1 for
+   the shared reject block), patched once all blocks are placed. */
+static void jit_emit_jump(JitBuffer *jit, const void *opcode, size_t length, int target)
+{
+  jit_emit(jit, opcode, length);
+  if (jit->fixup_count == jit->fixup_capacity)
+  {
+    jit->fixup_capacity = jit->fixup_capacity == 0 ? 256 : jit->fixup_capacity * 2;
+    jit->fixups = realloc(jit->fixups, jit->fixup_capacity * sizeof(int));
+    jit->fixup_state = realloc(jit->fixup_state, jit->fixup_capacity * sizeof(int));
+  }
+  jit->fixups[jit->fixup_count] = jit->length;
+  jit->fixup_state[jit->fixup_count++] = target;
+  jit_emit_u32(jit, 0);
+}
+
+void dfa_jit_free(DfaJit *jit)
+{
+  if (jit->code != NULL)
+  {
+    munmap(jit->code, jit->size);
+  }
+  memset(jit, 0, sizeof(*jit));
+}
+
+/* Compile dfa to native code; returns 0 (leaving jit->match NULL) when it
+   cannot, in which case the table interpreter should be used. */
+int dfa_jit_compile(const Dfa *dfa, DfaJit *jit)
+{
+  memset(jit, 0, sizeof(*jit));
+#if defined(__x86_64__)
+  static const unsigned char add_rsi_rdi[] = {0x48, 0x01, 0xfe};
+  static const unsigned char cmp_rdi_rsi[] = {0x48, 0x39, 0xf7};
+  static const unsigned char jae[] = {0x0f, 0x83};
+  static const unsigned char movzx_eax_rdi[] = {0x0f, 0xb6, 0x07};
+  static const unsigned char inc_rdi[] = {0x48, 0xff, 0xc7};
+  static const unsigned char je[] = {0x0f, 0x84};
+  static const unsigned char jbe[] = {0x0f, 0x86};
+  static const unsigned char jmp[] = {0xe9};
+  static const unsigned char ret_reject[] = {0x31, 0xc0, 0xc3};
+  JitBuffer buffer = {0};
+  int *block = malloc(dfa->state_count * sizeof(int));
+  int *end_block = malloc(dfa->state_count * sizeof(int));
+  int reject = 0;
+  int ok = 1;
+
+  /* rsi becomes the end pointer; jump to the start block. */
+  jit_emit(&buffer, add_rsi_rdi, sizeof(add_rsi_rdi));
+  jit_emit_jump(&buffer, jmp, sizeof(jmp), 1);
+
+  for (int s = 1; s < dfa->state_count && ok; s++)
+  {
+    const unsigned short *row = dfa->table + (size_t)s * dfa->class_count;
+    int ranges = 0;
+
+    block[s] = buffer.length;
+    jit_emit(&buffer, cmp_rdi_rsi, sizeof(cmp_rdi_rsi));
+    jit_emit_jump(&buffer, jae, sizeof(jae), -2 - s);
+    jit_emit(&buffer, movzx_eax_rdi, sizeof(movzx_eax_rdi));
+    jit_emit(&buffer, inc_rdi, sizeof(inc_rdi));
+    for (int low = 0; low < 256;)
+    {
+      int target = row[dfa->byte_class[low]];
+      int high = low;
+      while (high + 1 < 256 && row[dfa->byte_class[high + 1]] == target)
+      {
+        high++;
+      }
+      if (target != DFA_DEAD)
+      {
+        if (++ranges > DFA_JIT_MAX_RANGES)
+        {
+          ok = 0;
+          break;
+        }
+        if (low == high)
+        {
+          unsigned char cmp_al[] = {0x3c, low};
+          jit_emit(&buffer, cmp_al, sizeof(cmp_al));
+          jit_emit_jump(&buffer, je, sizeof(je), target);
+        }
+        else
+        {
+          /* lea ecx, [rax - low]; cmp ecx, high - low; jbe target */
+          unsigned char lea[] = {0x8d, 0x88};
+          unsigned char cmp_ecx[] = {0x81, 0xf9};
+          jit_emit(&buffer, lea, sizeof(lea));
+          jit_emit_u32(&buffer, (unsigned int)-low);
+          jit_emit(&buffer, cmp_ecx, sizeof(cmp_ecx));
+          jit_emit_u32(&buffer, high - low);
+          jit_emit_jump(&buffer, jbe, sizeof(jbe), target);
+        }
+      }
+      low = high + 1;
+    }
+    jit_emit_jump(&buffer, jmp, sizeof(jmp), -1);
+
+    /* End of input: return whether s accepts. */
+    end_block[s] = buffer.length;
+    unsigned char ret_state[] = {0xb8, dfa->accepting[s], 0, 0, 0, 0xc3};
+    jit_emit(&buffer, ret_state, sizeof(ret_state));
+  }
+  reject = buffer.length;
+  jit_emit(&buffer, ret_reject, sizeof(ret_reject));
+
+  if (ok)
+  {
+    for (int f = 0; f < buffer.fixup_count; f++)
+    {
+      int target = buffer.fixup_state[f];
+      int to = target == -1 ? reject : target <= -2 ? end_block[-2 - target] : block[target];
+      unsigned int rel = to - (buffer.fixups[f] + 4);
+      memcpy(buffer.code + buffer.fixups[f], &rel, 4);
+    }
+    size_t size = (buffer.length + 4095) & ~(size_t)4095;
+    void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+      ok = 0;
+    }
+    else
+    {
+      memcpy(code, buffer.code, buffer.length);
+      if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+      {
+        munmap(code, size);
+        ok = 0;
+      }
+      else
+      {
+        jit->code = code;
+        jit->size = size;
+        jit->match = (int (*)(const unsigned char *, size_t))code;
+      }
+    }
+  }
+
+  free(buffer.code);
+  free(buffer.fixups);
+  free(buffer.fixup_state);
+  free(block);
+  free(end_block);
+  return ok;
+#else
+  (void)dfa;
+  return 0;
+#endif
+}
+
+/* Run the JIT code when there is some, else the table interpreter. */
+int dfa_jit_accepts(const DfaJit *jit, const Dfa *dfa, const char *string, size_t length)
+{
+  if (jit->match != NULL)
+  {
+    return jit->match((const unsigned char *)string, length);
+  }
+  return dfa_accepts(dfa, string, length);
+}
+
+/* Bit-parallel Glushkov NFA.
+
+   Glushkov positions are the NFA's byte edges, plus position 0 for the
+   start. The state is a bit vector of active positions, at most
+   BITNFA_WORDS 64-bit words. Each byte advances it as
+   D' = follow(D) & bytes[c], where follow(D) is the union of the follow
+   sets of D's positions. Most follow edges p -> q of a pattern share a
+   few offsets q - p (+1 along a concatenation, small negative ones back
+   to the start of a loop), so for the most common offsets d, follow(D)
+   takes (D & mask_d) shifted by d, as in Shift-And. Any other edges are
+   read from one table per 8-bit chunk of D's remaining positions. Unlike
+   a DFA, the tables grow linearly with the pattern. */
+
+#define BITNFA_MAX_POSITIONS 256
+#define BITNFA_WORDS ((BITNFA_MAX_POSITIONS + 1 + 63) / 64)
+#define BITNFA_MAX_SHIFTS 8
+
+typedef struct
+{
+  int positions;
+  int words;                      /* Words of state in use */
+  int chunks;                     /* 8-bit chunks of state in use */
+  int shift_count;
+  int shifts[BITNFA_MAX_SHIFTS];  /* Edge offsets handled by shifting */
+  unsigned long long shift_masks[BITNFA_MAX_SHIFTS][BITNFA_WORDS]; /* Sources of those edges */
+  unsigned long long irregular[BITNFA_WORDS]; /* Positions with edges left to the tables */
+  unsigned long long *follow;     /* [chunk][chunk value][word], remaining edges only */
+  unsigned long long *bytes;      /* [byte][word]: positions accepting the byte */
+  unsigned long long last[BITNFA_WORDS]; /* Positions that can end a match */
+} BitNfa;
+
+void bitnfa_free(BitNfa *bitnfa)
+{
+  free(bitnfa->follow);
+  free(bitnfa->bytes);
+  memset(bitnfa, 0, sizeof(*bitnfa));
+}
+
+/* Number the NFA's byte edges as Glushkov positions and build the shift
+   masks and tables; fails for more than BITNFA_MAX_POSITIONS positions. */
+int bitnfa_build(const Nfa *nfa, BitNfa *bitnfa, char *error, size_t error_size)
+{
+  int *position = malloc(nfa->count * sizeof(int));
+  int *state_of = malloc((nfa->count + 1) * sizeof(int));
+  int *stack = malloc(nfa->count * sizeof(int));
+  int nfa_words = (nfa->count + 63) / 64;
+  unsigned long *set = malloc(nfa_words * sizeof(unsigned long));
+  int m = 0;
+
+  memset(bitnfa, 0, sizeof(*bitnfa));
+  for (int s = 0; s < nfa->count; s++)
+  {
+    position[s] = nfa->states[s].next >= 0 ? ++m : -1;
+    if (position[s] > 0)
+    {
+      state_of[position[s]] = s;
+    }
+  }
+  if (m > BITNFA_MAX_POSITIONS)
+  {
+    snprintf(error, error_size, "pattern has %d positions, more than %d", m, BITNFA_MAX_POSITIONS);
+    free(set);
+    free(stack);
+    free(state_of);
+    free(position);
+    return 0;
+  }
+
+  bitnfa->positions = m;
+  bitnfa->words = (m + 1 + 63) / 64;
+  bitnfa->chunks = (m + 1 + 7) / 8;
+  int words = bitnfa->words;
+  bitnfa->follow = calloc((size_t)bitnfa->chunks * 256 * words, sizeof(unsigned long long));
+  bitnfa->bytes = calloc((size_t)256 * words, sizeof(unsigned long long));
+  unsigned long long *single = calloc((size_t)(m + 1) * words, sizeof(unsigned long long));
+
+  /* Follow set of each position: the byte edges in the closure of where
+     its edge leads (the start closure for position 0) */
+  for (int p = 0; p <= m; p++)
+  {
+    int from = p == 0 ? nfa->start : nfa->states[state_of[p]].next;
+    memset(set, 0, nfa_words * sizeof(unsigned long));
+    set[from / 64] |= 1UL << (from % 64);
+    nfa_closure(nfa, set, stack);
+    for (int s = 0; s < nfa->count; s++)
+    {
+      if (set[s / 64] >> (s % 64) & 1)
+      {
+        if (position[s] > 0)
+        {
+          single[(size_t)p * words + position[s] / 64] |= 1ULL << (position[s] % 64);
+        }
+        if (s == nfa->accept)
+        {
+          bitnfa->last[p / 64] |= 1ULL << (p % 64);
+        }
+      }
+    }
+  }
+  for (int p = 1; p <= m; p++)
+  {
+    for (int b = 0; b < 256; b++)
+    {
+      if (byte_set_has(nfa->states[state_of[p]].bytes, b))
+      {
+        bitnfa->bytes[(size_t)b * words + p / 64] |= 1ULL << (p % 64);
+      }
+    }
+  }
+
+  /* Give the most common edge offsets to shifts, then drop their edges.
+     A one-word state needs at most eight table loads, which beats the
+     shifts, so it keeps every edge in the tables. */
+  int offset_edges[127] = {0};
+  for (int p = 0; p <= m; p++)
+  {
+    for (int q = 0; q <= m; q++)
+    {
+      if ((single[(size_t)p * words + q / 64] >> (q % 64) & 1) && q - p > -64 && q - p < 64)
+      {
+        offset_edges[q - p + 63]++;
+      }
+    }
+  }
+  while (words > 1 && bitnfa->shift_count < BITNFA_MAX_SHIFTS)
+  {
+    int best = 0;
+    for (int d = 1; d < 127; d++)
+    {
+      best = offset_edges[d] > offset_edges[best] ? d : best;
+    }
+    if (offset_edges[best] == 0)
+    {
+      break;
+    }
+    int j = bitnfa->shift_count++;
+    bitnfa->shifts[j] = best - 63;
+    offset_edges[best] = 0;
+    for (int p = 0; p <= m; p++)
+    {
+      int q = p + bitnfa->shifts[j];
+      if (q >= 0 && q <= m && (single[(size_t)p * words + q / 64] >> (q % 64) & 1))
+      {
+        bitnfa->shift_masks[j][p / 64] |= 1ULL << (p % 64);
+        single[(size_t)p * words + q / 64] &= ~(1ULL << (q % 64));
+      }
+    }
+  }
+  for (int p = 0; p <= m; p++)
+  {
+    for (int w = 0; w < words; w++)
+    {
+      if (single[(size_t)p * words + w] != 0)
+      {
+        bitnfa->irregular[p / 64] |= 1ULL << (p % 64);
+      }
+    }
+  }
+
+  /* Chunk tables: entry v of chunk k is the union over the set bits of v */
+  for (int k = 0; k < bitnfa->chunks; k++)
+  {
+    unsigned long long *table = bitnfa->follow + (size_t)k * 256 * words;
+    for (int v = 1; v < 256; v++)
+    {
+      int bit = __builtin_ctz(v);
+      int p = k * 8 + bit;
+      const unsigned long long *rest = table + (size_t)(v & (v - 1)) * words;
+      for (int w = 0; w < words; w++)
+      {
+        table[(size_t)v * words + w] = rest[w] | (p <= m ? single[(size_t)p * words + w] : 0);
+      }
+    }
+  }
+
+  free(single);
+  free(set);
+  free(stack);
+  free(state_of);
+  free(position);
+  return 1;
+}
+
+/* Run the bit vector over the string. A one-word pattern (up to 63
+   positions) keeps its state in a register and uses only the tables. */
+int bitnfa_accepts(const BitNfa *bitnfa, const char *string, size_t length)
+{
+  const unsigned char *p = (const unsigned char *)string;
+  const unsigned char *end = p + length;
+  int words = bitnfa->words;
+
+  if (words == 1)
+  {
+    unsigned long long state = 1;
+    while (p < end)
+    {
+      unsigned long long next = 0;
+      unsigned long long rest = state & bitnfa->irregular[0];
+      for (int k = 0; rest != 0; k++, rest >>= 8)
+      {
+        next |= bitnfa->follow[(size_t)k * 256 + (rest & 0xff)];
+      }
+      state = next & bitnfa->bytes[*p++];
+      if (state == 0)
+      {
+        return 0;
+      }
+    }
+    return (state & bitnfa->last[0]) != 0;
+  }
+
+  unsigned long long state[BITNFA_WORDS] = {1};
+  while (p < end)
+  {
+    unsigned long long next[BITNFA_WORDS] = {0};
+    for (int j = 0; j < bitnfa->shift_count; j++)
+    {
+      const unsigned long long *mask = bitnfa->shift_masks[j];
+      int d = bitnfa->shifts[j];
+      if (d > 0)
+      {
+        unsigned long long carry = 0;
+        for (int w = 0; w < words; w++)
+        {
+          unsigned long long moved = state[w] & mask[w];
+          next[w] |= moved << d | carry;
+          carry = moved >> (64 - d);
+        }
+      }
+      else if (d < 0)
+      {
+        unsigned long long carry = 0;
+        for (int w = words - 1; w >= 0; w--)
+        {
+          unsigned long long moved = state[w] & mask[w];
+          next[w] |= moved >> -d | carry;
+          carry = moved << (64 + d);
+        }
+      }
+      else
+      {
+        for (int w = 0; w < words; w++)
+        {
+          next[w] |= state[w] & mask[w];
+        }
+      }
+    }
+    for (int w = 0; w < words; w++)
+    {
+      unsigned long long rest = state[w] & bitnfa->irregular[w];
+      for (int k = w * 8; rest != 0; k++, rest >>= 8)
+      {
+        if ((rest & 0xff) != 0)
+        {
+          const unsigned long long *row = bitnfa->follow + ((size_t)k * 256 + (rest & 0xff)) * words;
+          for (int x = 0; x < words; x++)
+          {
+            next[x] |= row[x];
+          }
+        }
+      }
+    }
+    const unsigned long long *accepting = bitnfa->bytes + (size_t)*p++ * words;
+    unsigned long long any = 0;
+    for (int w = 0; w < words; w++)
+    {
+      state[w] = next[w] & accepting[w];
+      any |= state[w];
+    }
+    if (any == 0)
+    {
+      return 0;
+    }
+  }
+  unsigned long long hit = 0;
+  for (int w = 0; w < words; w++)
+  {
+    hit |= state[w] & bitnfa->last[w];
+  }
+  return hit != 0;
+}
+
+/* Lazy DFA.
+
+   DFA states (sets of NFA states) are built on first visit and kept in a
+   cache of at most capacity states, so memory is fixed when the DFA is
+   created however large the full DFA would be. A cached transition costs
+   the same table load as the table DFA; an unknown one is computed from
+   the NFA and cached. When the cache is full it is flushed and refilled
+   from the current state. If it filled up again after fewer than
+   LAZY_DFA_MIN_BYTES_PER_STATE bytes per cached state, caching is not
+   paying off: strings go to the bit-parallel NFA instead (or, for
+   patterns too large for it, to stepping NFA state sets) for as many
+   bytes as the cache should have lasted, and then it is tried again
+   from empty. Each thrash in a row doubles that stretch, up to
+   LAZY_DFA_MAX_BACKOFF times, since refilling a cache that will only
+   thrash again costs far more than the NFA. A LazyDfa is not safe to share between threads
+   without a lock. */
+
+#define LAZY_DFA_MIN_BYTES_PER_STATE 10
+#define LAZY_DFA_MAX_BACKOFF 1024
+#define LAZY_DFA_ACCEPT 1
+#define LAZY_DFA_DEAD 2
+
+typedef struct
+{
+  Nfa nfa;
+  BitNfa bitnfa;              /* Fallback, when have_bitnfa */
+  int have_bitnfa;
+  int words;                  /* Words per NFA state set */
+  int class_count;
+  unsigned char byte_class[256];
+  unsigned char representative[256];
+
+  int capacity;
+  int count;
+  unsigned long *sets;        /* [capacity][words] */
+  int *table;                 /* [capacity][class]: next state, -1 unknown */
+  unsigned char *flags;       /* LAZY_DFA_ACCEPT, LAZY_DFA_DEAD */
+  int *slots;                 /* Open-addressing index of sets, -1 empty */
+  int slot_count;
+  int start;                  /* Cached start state, -1 after a flush */
+
+  unsigned long *start_set;
+  unsigned long *scratch;     /* Two sets of working space */
+  int *stack;
+
+  long bytes;                 /* All bytes passed in */
+  long cache_bytes;           /* Bytes run through the cache */
+  long misses;                /* Transitions computed from the NFA */
+  long flushes;
+  long fallbacks;             /* Times the cache thrashed */
+  long fallback_bytes;        /* Bytes run on the NFA instead */
+  long flush_mark;            /* cache_bytes at the last flush */
+  long nfa_until;             /* Skip the cache until bytes reaches this */
+  long backoff;               /* Multiplier of the next skip */
+  pthread_mutex_t lock;       /* For callers that share it (validators) */
+} LazyDfa;
+
+/* Take over nfa (the caller must not free it) and set up an empty cache
+   of capacity states. */
+void lazy_dfa_init(LazyDfa *lazy, Nfa *nfa, int capacity)
+{
+  memset(lazy, 0, sizeof(*lazy));
+  lazy->nfa = *nfa;
+  memset(nfa, 0, sizeof(*nfa));
+  char error[128];
+  lazy->have_bitnfa = bitnfa_build(&lazy->nfa, &lazy->bitnfa, error, sizeof(error));
+  lazy->words = (lazy->nfa.count + 63) / 64;
+  lazy->class_count = nfa_byte_classes(&lazy->nfa, lazy->byte_class, lazy->representative);
+  lazy->capacity = capacity < 2 ? 2 : capacity;
+  lazy->sets = malloc((size_t)lazy->capacity * lazy->words * sizeof(unsigned long));
+  lazy->table = malloc((size_t)lazy->capacity * lazy->class_count * sizeof(int));
+  lazy->flags = malloc(lazy->capacity);
+  lazy->slot_count = 1;
+  while (lazy->slot_count < 2 * lazy->capacity)
+  {
+    lazy->slot_count *= 2;
+  }
+  lazy->slots = malloc(lazy->slot_count * sizeof(int));
+  memset(lazy->slots, -1, lazy->slot_count * sizeof(int));
+  lazy->start = -1;
+  lazy->backoff = 1;
+  lazy->start_set = calloc(3 * lazy->words, sizeof(unsigned long));
+  lazy->scratch = lazy->start_set + lazy->words;
+  lazy->stack = malloc(lazy->nfa.count * sizeof(int));
+  lazy->start_set[lazy->nfa.start / 64] |= 1UL << (lazy->nfa.start % 64);
+  nfa_closure(&lazy->nfa, lazy->start_set, lazy->stack);
+  pthread_mutex_init(&lazy->lock, NULL);
+}
+
+void lazy_dfa_free(LazyDfa *lazy)
+{
+  nfa_free(&lazy->nfa);
+  if (lazy->have_bitnfa)
+  {
+    bitnfa_free(&lazy->bitnfa);
+  }
+  free(lazy->sets);
+  free(lazy->table);
+  free(lazy->flags);
+  free(lazy->slots);
+  free(lazy->start_set);
+  free(lazy->stack);
+  pthread_mutex_destroy(&lazy->lock);
+  memset(lazy, 0, sizeof(*lazy));
+}
+
+/* Bytes the cache occupies, fixed at init. */
+size_t lazy_dfa_memory(const LazyDfa *lazy)
+{
+  return (size_t)lazy->capacity * (lazy->words * sizeof(unsigned long) + lazy->class_count * sizeof(int) + 1) +
+         lazy->slot_count * sizeof(int);
+}
+
+/* The NFA states one byte of class c leads to from current, closed. */
+static void lazy_dfa_step(LazyDfa *lazy, const unsigned long *current, int c, unsigned long *next)
+{
+  const Nfa *nfa = &lazy->nfa;
+  int byte = lazy->representative[c];
+  memset(next, 0, lazy->words * sizeof(unsigned long));
+  for (int w = 0; w < lazy->words; w++)
+  {
+    for (unsigned long bits = current[w]; bits != 0; bits &= bits - 1)
+    {
+      const NfaState *state = &nfa->states[w * 64 + __builtin_ctzl(bits)];
+      if (state->next >= 0 && byte_set_has(state->bytes, byte))
+      {
+        next[state->next / 64] |= 1UL << (state->next % 64);
+      }
+    }
+  }
+  nfa_closure(nfa, next, lazy->stack);
+}
+
+/* Slot of set in the index: where it is, or the empty slot it would go. */
+static unsigned int lazy_dfa_slot(const LazyDfa *lazy, const unsigned long *set)
+{
+  unsigned int hash = 2166136261u;
+  for (int w = 0; w < lazy->words; w++)
+  {
+    hash = (hash ^ (unsigned int)(set[w] ^ set[w] >> 32)) * 16777619u;
+  }
+  unsigned int slot = hash & (lazy->slot_count - 1);
+  while (lazy->slots[slot] >= 0 &&
+         memcmp(lazy->sets + (size_t)lazy->slots[slot] * lazy->words, set, lazy->words * sizeof(unsigned long)) != 0)
+  {
+    slot = (slot + 1) & (lazy->slot_count - 1);
+  }
+  return slot;
+}
+
+/* The cached state for set, adding it (the cache must have room). */
+static int lazy_dfa_intern(LazyDfa *lazy, const unsigned long *set)
+{
+  unsigned int slot = lazy_dfa_slot(lazy, set);
+  if (lazy->slots[slot] >= 0)
+  {
+    return lazy->slots[slot];
+  }
+  int id = lazy->count++;
+  memcpy(lazy->sets + (size_t)id * lazy->words, set, lazy->words * sizeof(unsigned long));
+  for (int c = 0; c < lazy->class_count; c++)
+  {
+    lazy->table[(size_t)id * lazy->class_count + c] = -1;
+  }
+  int empty = 1;
+  for (int w = 0; w < lazy->words; w++)
+  {
+    empty &= set[w] == 0;
+  }
+  lazy->flags[id] = (set[lazy->nfa.accept / 64] >> (lazy->nfa.accept % 64) & 1 ? LAZY_DFA_ACCEPT : 0) |
+                    (empty ? LAZY_DFA_DEAD : 0);
+  lazy->slots[slot] = id;
+  return id;
+}
+
+static void lazy_dfa_flush(LazyDfa *lazy)
+{
+  lazy->count = 0;
+  lazy->start = -1;
+  memset(lazy->slots, -1, lazy->slot_count * sizeof(int));
+  lazy->flushes++;
+  lazy->flush_mark = lazy->cache_bytes;
+}
+
+/* Run the whole string on the NFA, without the cache. */
+static int lazy_dfa_simulate(LazyDfa *lazy, const char *string, size_t length)
+{
+  lazy->fallback_bytes += length;
+  if (lazy->have_bitnfa)
+  {
+    return bitnfa_accepts(&lazy->bitnfa, string, length);
+  }
+  unsigned long *current = lazy->scratch;
+  unsigned long *following = lazy->scratch + lazy->words;
+  memcpy(following, lazy->start_set, lazy->words * sizeof(unsigned long));
+  for (size_t i = 0; i < length; i++)
+  {
+    memcpy(current, following, lazy->words * sizeof(unsigned long));
+    lazy_dfa_step(lazy, current, lazy->byte_class[(unsigned char)string[i]], following);
+  }
+  return following[lazy->nfa.accept / 64] >> (lazy->nfa.accept % 64) & 1;
+}
+
+int lazy_dfa_accepts(LazyDfa *lazy, const char *string, size_t length)
+{
+  const unsigned char *begin = (const unsigned char *)string;
+  const unsigned char *p = begin;
+  const unsigned char *end = p + length;
+  int classes = lazy->class_count;
+  int state;
+
+  lazy->bytes += length;
+  if (lazy->bytes < lazy->nfa_until)
+  {
+    return lazy_dfa_simulate(lazy, string, length);
+  }
+  if (lazy->start < 0)
+  {
+    if (lazy->count == lazy->capacity)
+    {
+      lazy_dfa_flush(lazy);
+    }
+    lazy->start = lazy_dfa_intern(lazy, lazy->start_set);
+  }
+  state = lazy->start;
+
+  while (p < end && !(lazy->flags[state] & LAZY_DFA_DEAD))
+  {
+    int c = lazy->byte_class[*p];
+    int next = lazy->table[(size_t)state * classes + c];
+    if (next < 0)
+    {
+      unsigned long *current = lazy->scratch;
+      unsigned long *following = lazy->scratch + lazy->words;
+      lazy->misses++;
+      memcpy(current, lazy->sets + (size_t)state * lazy->words, lazy->words * sizeof(unsigned long));
+      lazy_dfa_step(lazy, current, c, following);
+      if (lazy->slots[lazy_dfa_slot(lazy, following)] < 0 && lazy->count == lazy->capacity)
+      {
+        if (lazy->cache_bytes + (p - begin) - lazy->flush_mark <
+            (long)LAZY_DFA_MIN_BYTES_PER_STATE * lazy->capacity)
+        {
+          /* Thrashing: leave the cache alone for as many bytes as it
+             should have lasted, then start it afresh */
+          lazy->fallbacks++;
+          lazy->cache_bytes += p - begin;
+          lazy->nfa_until = lazy->bytes + lazy->backoff * LAZY_DFA_MIN_BYTES_PER_STATE * lazy->capacity;
+          lazy->backoff = lazy->backoff < LAZY_DFA_MAX_BACKOFF ? 2 * lazy->backoff : LAZY_DFA_MAX_BACKOFF;
+          lazy_dfa_flush(lazy);
+          return lazy_dfa_simulate(lazy, string, length);
+        }
+        lazy->backoff = 1;
+        lazy_dfa_flush(lazy);
+        state = lazy_dfa_intern(lazy, current);
+      }
+      next = lazy_dfa_intern(lazy, following);
+      lazy->table[(size_t)state * classes + c] = next;
+    }
+    state = next;
+    p++;
+  }
+  lazy->cache_bytes += p - begin;
+  return p == end && (lazy->flags[state] & LAZY_DFA_ACCEPT);
+}
+
+/* Print the cache's hit rate, flushes and fallbacks. */
+void lazy_dfa_report(const LazyDfa *lazy, const char *name)
+{
+  printf("%s: %d of %d states cached (%zu bytes), %.2f%% hits over %ld bytes, %ld flushes, "
+         "thrashed %ld times, %ld of %ld bytes on the NFA\n", name, lazy->count, lazy->capacity,
+         lazy_dfa_memory(lazy),
+         lazy->cache_bytes > 0 ? 100.0 * (lazy->cache_bytes - lazy->misses) / lazy->cache_bytes : 0.0,
+         lazy->cache_bytes, lazy->flushes, lazy->fallbacks, lazy->fallback_bytes, lazy->bytes);
+}
+
+/* A pattern compiled to whichever backend suits its size: the table DFA
+   while the pattern is small and determinises within DFA_MAX_STATES, the
+   bit-parallel NFA up to BITNFA_MAX_POSITIONS, otherwise the lazy DFA
+   with a cache of MATCHER_LAZY_STATES states. */
+
+#define MATCHER_DFA_MAX_POSITIONS 32
+#define MATCHER_LAZY_STATES 1024
+
+typedef enum
+{
+  MATCHER_DFA,
+  MATCHER_BITNFA,
+  MATCHER_LAZY
+} MatcherBackend;
+
+typedef struct
+{
+  MatcherBackend backend;
+  int positions;
+  Dfa dfa;
+  BitNfa bitnfa;
+  LazyDfa *lazy;
+} Matcher;
+
+static const char *matcher_backend_name(MatcherBackend backend)
+{
+  return backend == MATCHER_DFA ? "dfa" : backend == MATCHER_BITNFA ? "bitnfa" : "lazy";
+}
+
+/* Compile source with the backend chosen by its size; on failure returns 0
+   with a message in error. */
+int matcher_compile(const char *source, Matcher *matcher, char *error, size_t error_size)
+{
+  Nfa nfa;
+  memset(matcher, 0, sizeof(*matcher));
+  if (!regex_parse(source, &nfa, error, error_size))
+  {
+    return 0;
+  }
+  for (int s = 0; s < nfa.count; s++)
+  {
+    matcher->positions += nfa.states[s].next >= 0;
+  }
+  int ok = 0;
+  if (matcher->positions <= MATCHER_DFA_MAX_POSITIONS && dfa_build(&nfa, &matcher->dfa, error, error_size))
+  {
+    matcher->backend = MATCHER_DFA;
+    ok = 1;
+  }
+  else if (matcher->positions <= BITNFA_MAX_POSITIONS && bitnfa_build(&nfa, &matcher->bitnfa, error, error_size))
+  {
+    matcher->backend = MATCHER_BITNFA;
+    ok = 1;
+  }
+  else
+  {
+    matcher->backend = MATCHER_LAZY;
+    matcher->lazy = malloc(sizeof(LazyDfa));
+    lazy_dfa_init(matcher->lazy, &nfa, MATCHER_LAZY_STATES);
+    return 1;
+  }
+  nfa_free(&nfa);
+  return ok;
+}
+
+int matcher_accepts(const Matcher *matcher, const char *string, size_t length)
+{
+  if (matcher->backend == MATCHER_DFA)
+  {
+    return dfa_accepts(&matcher->dfa, string, length);
+  }
+  if (matcher->backend == MATCHER_BITNFA)
+  {
+    return bitnfa_accepts(&matcher->bitnfa, string, length);
+  }
+  pthread_mutex_lock(&matcher->lazy->lock);
+  int valid = lazy_dfa_accepts(matcher->lazy, string, length);
+  pthread_mutex_unlock(&matcher->lazy->lock);
+  return valid;
+}
+
+void matcher_free(Matcher *matcher)
+{
+  dfa_free(&matcher->dfa);
+  bitnfa_free(&matcher->bitnfa);
+  if (matcher->lazy != NULL)
+  {
+    lazy_dfa_free(matcher->lazy);
+    free(matcher->lazy);
+  }
+}
+
+/* Compiled-pattern cache.
+
+   A cache file holds table DFAs ready to run: a header, a directory of
+   entries sorted by the 64-bit FNV-1a hash of the pattern source, then
+   for each entry the source (to rule out hash collisions), the byte
+   classes, the transition table and the accepting flags, each 8-byte
+   aligned. dfa_cache_find points a Dfa straight into the read-only
+   mapping, so loading costs a lookup and a check of the table instead of
+   a subset construction. The file is in native byte order; one written
+   on a machine of the other order fails the version check. */
+
+#define DFA_CACHE_MAGIC "PATDFA\0\0"
+#define DFA_CACHE_VERSION 1
+
+typedef struct
+{
+  char magic[8];
+  unsigned int version;
+  unsigned int count;
+} DfaCacheHeader;
+
+typedef struct
+{
+  unsigned long hash;
+  unsigned long offset;
+  unsigned int source_length;
+  unsigned int state_count;
+  unsigned int class_count;
+  unsigned int reserved;
+} DfaCacheEntry;
+
+typedef struct
+{
+  const unsigned char *base;
+  size_t size;
+  const DfaCacheEntry *entries;
+  unsigned int count;
+} DfaCache;
+
+static unsigned long source_hash(const char *source)
+{
+  unsigned long hash = 14695981039346656037UL;
+  for (const unsigned char *p = (const unsigned char *)source; *p != '\0'; p++)
+  {
+    hash = (hash ^ *p) * 1099511628211UL;
+  }
+  return hash;
+}
+
+static size_t align8(size_t size)
+{
+  return (size + 7) & ~(size_t)7;
+}
+
+/* Bytes of an entry's data after the directory. */
+static size_t dfa_cache_entry_size(size_t source_length, size_t state_count, size_t class_count)
+{
+  return align8(source_length) + 256 + align8(state_count * class_count * sizeof(unsigned short)) +
+         align8(state_count);
+}
+
+static int compare_cache_entries(const void *a, const void *b)
+{
+  unsigned long x = ((const DfaCacheEntry *)a)->hash;
+  unsigned long y = ((const DfaCacheEntry *)b)->hash;
+  return x < y ? -1 : x > y;
+}
+
+/* Compile every source and write the cache to path, through a temporary
+   file renamed into place. Returns 0 with a message in error when a
+   pattern does not compile or the file cannot be written. */
+int dfa_cache_write(const char *path, const char *const *sources, int count, char *error, size_t error_size)
+{
+  Dfa *dfas = calloc(count, sizeof(Dfa));
+  DfaCacheEntry *entries = calloc(count, sizeof(DfaCacheEntry));
+  int *order = malloc(count * sizeof(int));
+  int ok = 1;
+
+  for (int i = 0; i < count && ok; i++)
+  {
+    ok = dfa_compile(sources[i], &dfas[i], error, error_size);
+    entries[i].hash = source_hash(sources[i]);
+    entries[i].source_length = strlen(sources[i]);
+    entries[i].state_count = dfas[i].state_count;
+    entries[i].class_count = dfas[i].class_count;
+    entries[i].reserved = i;
+  }
+  if (ok)
+  {
+    qsort(entries, count, sizeof(DfaCacheEntry), compare_cache_entries);
+    size_t offset = sizeof(DfaCacheHeader) + count * sizeof(DfaCacheEntry);
+    for (int i = 0; i < count; i++)
+    {
+      order[i] = entries[i].reserved;
+      entries[i].reserved = 0;
+      entries[i].offset = offset;
+      offset += dfa_cache_entry_size(entries[i].source_length, entries[i].state_count, entries[i].class_count);
+    }
+
+    char *temporary = malloc(strlen(path) + 8);
+    sprintf(temporary, "%s.tmp", path);
+    FILE *out = fopen(temporary, "wb");
+    if (out == NULL)
+    {
+      snprintf(error, error_size, "Could not create file '%s'", temporary);
+      ok = 0;
+    }
+    else
+    {
+      static const unsigned char zeros[8];
+      DfaCacheHeader header;
+      memcpy(header.magic, DFA_CACHE_MAGIC, 8);
+      header.version = DFA_CACHE_VERSION;
+      header.count = count;
+      fwrite(&header, sizeof(header), 1, out);
+      fwrite(entries, sizeof(DfaCacheEntry), count, out);
+      for (int i = 0; i < count; i++)
+      {
+        const Dfa *dfa = &dfas[order[i]];
+        size_t length = entries[i].source_length;
+        size_t table = (size_t)dfa->state_count * dfa->class_count * sizeof(unsigned short);
+        fwrite(sources[order[i]], 1, length, out);
+        fwrite(zeros, 1, align8(length) - length, out);
+        fwrite(dfa->byte_class, 1, 256, out);
+        fwrite(dfa->table, 1, table, out);
+        fwrite(zeros, 1, align8(table) - table, out);
+        fwrite(dfa->accepting, 1, dfa->state_count, out);
+        fwrite(zeros, 1, align8(dfa->state_count) - dfa->state_count, out);
+      }
+      if (ferror(out) | fclose(out) || rename(temporary, path) != 0)
+      {
+        snprintf(error, error_size, "Could not write file '%s'", path);
+        unlink(temporary);
+        ok = 0;
+      }
+    }
+    free(temporary);
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    dfa_free(&dfas[i]);
+  }
+  free(dfas);
+  free(entries);
+  free(order);
+  return ok;
+}
+
+/* Map a cache file and check its header and directory; returns 0 with a
+   message in error when it is missing, truncated or of another version. */
+int dfa_cache_open(const char *path, DfaCache *cache, char *error, size_t error_size)
+{
+  memset(cache, 0, sizeof(*cache));
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    snprintf(error, error_size, "Could not open file '%s'", path);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return 0;
+  }
+  if ((size_t)st.st_size < sizeof(DfaCacheHeader))
+  {
+    snprintf(error, error_size, "'%s' is not a pattern cache", path);
+    close(fd);
+    return 0;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    snprintf(error, error_size, "Could not map file '%s'", path);
+    return 0;
+  }
+
+  const DfaCacheHeader *header = base;
+  if (memcmp(header->magic, DFA_CACHE_MAGIC, 8) != 0 || header->version != DFA_CACHE_VERSION ||
+      header->count > (st.st_size - sizeof(DfaCacheHeader)) / sizeof(DfaCacheEntry))
+  {
+    snprintf(error, error_size, "'%s' is not a version %d pattern cache", path, DFA_CACHE_VERSION);
+    munmap(base, st.st_size);
+    return 0;
+  }
+  cache->base = base;
+  cache->size = st.st_size;
+  cache->entries = (const DfaCacheEntry *)(header + 1);
+  cache->count = header->count;
+  return 1;
+}
+
+void dfa_cache_close(DfaCache *cache)
+{
+  if (cache->base != NULL)
+  {
+    munmap((void *)cache->base, cache->size);
+  }
+  memset(cache, 0, sizeof(*cache));
+}
+
+/* Point dfa at the cached DFA for source; returns 0 if the cache has none
+   or its entry is damaged. The Dfa shares the mapping: it must not be
+   passed to dfa_free and is valid until dfa_cache_close. */
+int dfa_cache_find(const DfaCache *cache, const char *source, Dfa *dfa)
+{
+  unsigned long hash = source_hash(source);
+  size_t length = strlen(source);
+  size_t low = 0;
+  size_t high = cache->count;
+
+  while (low < high)
+  {
+    size_t middle = (low + high) / 2;
+    if (cache->entries[middle].hash < hash)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  for (; low < cache->count && cache->entries[low].hash == hash; low++)
+  {
+    const DfaCacheEntry *entry = &cache->entries[low];
+    size_t states = entry->state_count;
+    size_t classes = entry->class_count;
+    if (entry->source_length != length || states < 2 || states > DFA_MAX_STATES || classes < 1 ||
+        classes > 256 || entry->offset % 8 != 0 || entry->offset > cache->size ||
+        dfa_cache_entry_size(length, states, classes) > cache->size - entry->offset)
+    {
+      continue;
+    }
+    const unsigned char *p = cache->base + entry->offset;
+    if (memcmp(p, source, length) != 0)
+    {
+      continue;
+    }
+    p += align8(length);
+    const unsigned char *byte_class = p;
+    const unsigned short *table = (const unsigned short *)(p + 256);
+    const unsigned char *accepting = p + 256 + align8(states * classes * sizeof(unsigned short));
+
+    /* A damaged file must not send the interpreter out of the table */
+    int valid = 1;
+    for (int b = 0; b < 256; b++)
+    {
+      valid &= byte_class[b] < classes;
+    }
+    for (size_t t = 0; t < states * classes; t++)
+    {
+      valid &= table[t] < states;
+    }
+    if (!valid)
+    {
+      continue;
+    }
+
+    dfa->state_count = states;
+    dfa->class_count = classes;
+    memcpy(dfa->byte_class, byte_class, 256);
+    dfa->table = (unsigned short *)table;
+    dfa->accepting = (unsigned char *)accepting;
+    return 1;
+  }
+  return 0;
+}
+
+/* The DFA for source from the cache when it has one, else compiled. Sets
+   *mapped to say which, since only a compiled one is freed. */
+int dfa_load(const DfaCache *cache, const char *source, Dfa *dfa, int *mapped, char *error, size_t error_size)
+{
+  *mapped = cache != NULL && dfa_cache_find(cache, source, dfa);
+  return *mapped || dfa_compile(source, dfa, error, error_size);
+}
+
+/* The pattern2 languages as regular expressions. */
+static const char *const pattern2_sources[2] = {"a*bb", "a+bb"};
+static Dfa pattern2_first_dfa;
+static Dfa pattern2_second_dfa;
+static DfaJit pattern2_first_jit;
+static DfaJit pattern2_second_jit;
+static BitNfa pattern2_first_bitnfa;
+static BitNfa pattern2_second_bitnfa;
+static LazyDfa pattern2_first_lazy;
+static LazyDfa pattern2_second_lazy;
+
+/* Build the pattern2 automata, taking the DFAs from cache when it is
+   not NULL and has them. */
+void init_pattern_dfas(const DfaCache *cache)
+{
+  char error[128];
+  int mapped;
+  if (!dfa_load(cache, pattern2_sources[0], &pattern2_first_dfa, &mapped, error, sizeof(error)) ||
+      !dfa_load(cache, pattern2_sources[1], &pattern2_second_dfa, &mapped, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    exit(1);
+  }
+  dfa_jit_compile(&pattern2_first_dfa, &pattern2_first_jit);
+  dfa_jit_compile(&pattern2_second_dfa, &pattern2_second_jit);
+
+  Nfa nfa;
+  if (!regex_parse(pattern2_sources[0], &nfa, error, sizeof(error)) ||
+      !bitnfa_build(&nfa, &pattern2_first_bitnfa, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    exit(1);
+  }
+  nfa_free(&nfa);
+  if (!regex_parse(pattern2_sources[1], &nfa, error, sizeof(error)) ||
+      !bitnfa_build(&nfa, &pattern2_second_bitnfa, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    exit(1);
+  }
+  nfa_free(&nfa);
+
+  regex_parse(pattern2_sources[0], &nfa, error, sizeof(error));
+  lazy_dfa_init(&pattern2_first_lazy, &nfa, 16);
+  regex_parse(pattern2_sources[1], &nfa, error, sizeof(error));
+  lazy_dfa_init(&pattern2_second_lazy, &nfa, 16);
+}
+
+/* Validators share the batch, stream and benchmark drivers below. */
+
+typedef struct Validator
+{
+  const char *name;
+  const char *description;
+  int (*accepts)(const struct Validator *validator, const char *string, size_t length);
+  const Automaton *automaton;
+  int min_length;
+  const Dfa *dfa;
+  const DfaJit *jit;
+  const BitNfa *bitnfa;
+  LazyDfa *lazy;
+  const Matcher *matcher;
+} Validator;
+
+static int pattern2_validator(const Validator *validator, const char *string, size_t length)
+{
+  return pattern2(string, (int)length, validator->min_length);
+}
+
+static int automaton_validator(const Validator *validator, const char *string, size_t length)
+{
+  return automaton_accepts(validator->automaton, string, length);
+}
+
+static int dfa_validator(const Validator *validator, const char *string, size_t length)
+{
+  return dfa_accepts(validator->dfa, string, length);
+}
+
+static int jit_validator(const Validator *validator, const char *string, size_t length)
+{
+  return dfa_jit_accepts(validator->jit, validator->dfa, string, length);
+}
+
+static int bitnfa_validator(const Validator *validator, const char *string, size_t length)
+{
+  return bitnfa_accepts(validator->bitnfa, string, length);
+}
+
+/* Validators can be called from several service threads at once, and
+   the lazy DFA's cache is not shared safely without the lock. */
+static int lazy_validator(const Validator *validator, const char *string, size_t length)
+{
+  pthread_mutex_lock(&validator->lazy->lock);
+  int valid = lazy_dfa_accepts(validator->lazy, string, length);
+  pthread_mutex_unlock(&validator->lazy->lock);
+  return valid;
+}
+
+static const Validator validators[] = {
+    {.name = "pattern2-first", .description = "a*bb (1stprogram.c)", .accepts = pattern2_validator,
+     .min_length = 2},
+    {.name = "pattern2-second", .description = "a+bb (2ndprogram.c)", .accepts = pattern2_validator,
+     .min_length = 3},
+    {.name = "anbn", .description = "a^n b^n, n >= 1", .accepts = automaton_validator,
+     .automaton = &anbn_automaton},
+    {.name = "anb2n", .description = "a^n b^2n, n >= 1", .accepts = automaton_validator,
+     .automaton = &anb2n_automaton},
+    {.name = "balanced", .description = "balanced (), [] and {}", .accepts = automaton_validator,
+     .automaton = &balanced_automaton},
+    {.name = "dfa-first", .description = "a*bb as a table DFA", .accepts = dfa_validator,
+     .dfa = &pattern2_first_dfa},
+    {.name = "dfa-second", .description = "a+bb as a table DFA", .accepts = dfa_validator,
+     .dfa = &pattern2_second_dfa},
+    {.name = "jit-first", .description = "a*bb as x86-64 code (table DFA fallback)", .accepts = jit_validator,
+     .dfa = &pattern2_first_dfa, .jit = &pattern2_first_jit},
+    {.name = "jit-second", .description = "a+bb as x86-64 code (table DFA fallback)", .accepts = jit_validator,
+     .dfa = &pattern2_second_dfa, .jit = &pattern2_second_jit},
+    {.name = "bitnfa-first", .description = "a*bb as a bit-parallel NFA", .accepts = bitnfa_validator,
+     .bitnfa = &pattern2_first_bitnfa},
+    {.name = "bitnfa-second", .description = "a+bb as a bit-parallel NFA", .accepts = bitnfa_validator,
+     .bitnfa = &pattern2_second_bitnfa},
+    {.name = "lazy-first", .description = "a*bb as a lazily built DFA", .accepts = lazy_validator,
+     .lazy = &pattern2_first_lazy},
+    {.name = "lazy-second", .description = "a+bb as a lazily built DFA", .accepts = lazy_validator,
+     .lazy = &pattern2_second_lazy},
+};
+
+#define VALIDATOR_COUNT (int)(sizeof(validators) / sizeof(validators[0]))
+
+const Validator *find_validator(const char *name)
+{
+  for (int i = 0; i < VALIDATOR_COUNT; i++)
+  {
+    if (strcmp(validators[i].name, name) == 0)
+    {
+      return &validators[i];
+    }
+  }
+  return NULL;
+}
+
+static void report(const char *string, int valid)
+{
+  if (valid)
+  {
+    printf("Valid string: %s\n", string);
+  }
+  else
+  {
+    printf("Invalid string: %s\n", string);
+  }
+}
+
+/* The original prompt-driven loop of the pattern programs. */
+void run_interactive(const Validator *validator)
+{
+  char string[100];
+  int test;
+
+  printf("Enter the number of test cases: ");
+  if (scanf("%d", &test) != 1)
+  {
+    return;
+  }
+
+  for (int i = 0; i < test; i++)
+  {
+    printf("Enter string for test case %d: ", i + 1);
+    if (scanf("%99s", string) != 1)
+    {
+      return;
+    }
+    report(string, validator->accepts(validator, string, strlen(string)));
+  }
+}
+
+/* Validate every line of a stream, one string per line. Lines are read in
+   64 KiB chunks and assembled in a reusable buffer, so memory only grows for
+   a line longer than any seen before. */
+long run_stream(const Validator *validator, FILE *in, int quiet)
+{
+  char chunk[65536];
+  size_t line_capacity = 256;
+  size_t line_length = 0;
+  char *line = malloc(line_capacity);
+  long valid = 0;
+  long total = 0;
+  size_t n;
+
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0 || line_length > 0)
+  {
+    size_t start = 0;
+    int at_eof = n == 0;
+
+    while (start < n || at_eof)
+    {
+      const char *newline = at_eof ? NULL : memchr(chunk + start, '\n', n - start);
+      size_t end = newline != NULL ? (size_t)(newline - chunk) : n;
+
+      if (line_length + (end - start) + 1 > line_capacity)
+      {
+        while (line_length + (end - start) + 1 > line_capacity)
+        {
+          line_capacity *= 2;
+        }
+        line = realloc(line, line_capacity);
+      }
+      memcpy(line + line_length, chunk + start, end - start);
+      line_length += end - start;
+      if (newline == NULL && !at_eof)
+      {
+        break;
+      }
+
+      if (line_length > 0 && line[line_length - 1] == '\r')
+      {
+        line_length--;
+      }
+      line[line_length] = '\0';
+      int ok = validator->accepts(validator, line, line_length);
+      valid += ok;
+      total++;
+      if (!quiet)
+      {
+        report(line, ok);
+      }
+      line_length = 0;
+      start = end + 1;
+      if (at_eof)
+      {
+        break;
+      }
+    }
+  }
+  free(line);
+  return total - valid;
+}
+
+static long now_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Generate count strings near the validator's language boundary: runs of
+   'a's followed by runs of 'b's (or bracket sequences for "balanced"), with
+   some lengths off by one and some bytes flipped. */
+char *generate_inputs(const Validator *validator, int count, int max_length, unsigned int seed, size_t **offsets)
+{
+  size_t capacity = (size_t)count * (max_length + 1);
+  char *data = malloc(capacity);
+  size_t pos = 0;
+
+  *offsets = malloc((count + 1) * sizeof(size_t));
+  srand(seed);
+  for (int i = 0; i < count; i++)
+  {
+    int length = 1 + rand() % max_length;
+    (*offsets)[i] = pos;
+    if (strcmp(validator->name, "balanced") == 0)
+    {
+      const char *pairs = "()[]{}";
+      int depth = 0;
+      char stack[512];
+      for (int j = 0; j < length; j++)
+      {
+        if (depth > 0 && (rand() % 2 || length - j <= depth))
+        {
+          data[pos++] = stack[--depth];
+        }
+        else if (depth < (int)sizeof(stack))
+        {
+          int p = rand() % 3;
+          data[pos++] = pairs[2 * p];
+          stack[depth++] = pairs[2 * p + 1];
+        }
+      }
+    }
+    else
+    {
+      int as = rand() % (length + 1);
+      for (int j = 0; j < length; j++)
+      {
+        data[pos++] = j < as ? 'a' : 'b';
+      }
+    }
+    if (rand() % 4 == 0 && pos > (*offsets)[i])
+    {
+      data[(*offsets)[i] + rand() % (pos - (*offsets)[i])] ^= 3;
+    }
+  }
+  (*offsets)[count] = pos;
+  return data;
+}
+
+/* Time the validator over generated inputs. */
+void run_benchmark(const Validator *validator, int count, int max_length)
+{
+  size_t *offsets;
+  char *data = generate_inputs(validator, count, max_length, 12345, &offsets);
+  long valid = 0;
+  long start = now_nanos();
+
+  for (int i = 0; i < count; i++)
+  {
+    valid += validator->accepts(validator, data + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+
+  long elapsed = now_nanos() - start;
+  printf("%s: %d strings (%ld valid), %zu bytes in %.3f ms: %.1f Mstrings/s, %.1f MB/s\n",
+         validator->name, count, valid, offsets[count], elapsed / 1e6,
+         elapsed > 0 ? count * 1e3 / elapsed : 0.0, elapsed > 0 ? offsets[count] * 1e3 / elapsed : 0.0);
+  free(offsets);
+  free(data);
+}
+
+/* Time pattern2, the table DFA, the JIT, the bit-parallel NFA and the
+   lazy DFA on the same generated inputs for both pattern2 languages, and
+   count disagreements with pattern2. */
+void run_engine_comparison(int count, int max_length)
+{
+  static const char *groups[2][5] = {
+      {"pattern2-first", "dfa-first", "jit-first", "bitnfa-first", "lazy-first"},
+      {"pattern2-second", "dfa-second", "jit-second", "bitnfa-second", "lazy-second"},
+  };
+
+  for (int g = 0; g < 2; g++)
+  {
+    const Validator *reference = find_validator(groups[g][0]);
+    size_t *offsets;
+    char *data = generate_inputs(reference, count, max_length, 777, &offsets);
+
+    for (int e = 0; e < 5; e++)
+    {
+      const Validator *validator = find_validator(groups[g][e]);
+      long valid = 0;
+      long mismatches = 0;
+      long start = now_nanos();
+      for (int i = 0; i < count; i++)
+      {
+        valid += validator->accepts(validator, data + offsets[i], offsets[i + 1] - offsets[i]);
+      }
+      long elapsed = now_nanos() - start;
+      for (int i = 0; i < count; i++)
+      {
+        size_t length = offsets[i + 1] - offsets[i];
+        mismatches += validator->accepts(validator, data + offsets[i], length) !=
+                      reference->accepts(reference, data + offsets[i], length);
+      }
+      printf("%-16s %.3f ms, %.1f Mstrings/s, %.1f MB/s, %ld valid, %ld mismatches%s\n", validator->name,
+             elapsed / 1e6, elapsed > 0 ? count * 1e3 / elapsed : 0.0,
+             elapsed > 0 ? offsets[count] * 1e3 / elapsed : 0.0, valid, mismatches,
+             validator->jit != NULL && validator->jit->match == NULL ? " (JIT unavailable, table DFA)" : "");
+    }
+    free(offsets);
+    free(data);
+  }
+}
+
+/* count random strings over {a, b} of 1 to max_length bytes. */
+static char *random_ab_strings(int count, int max_length, unsigned int seed, size_t **offsets)
+{
+  char *data = malloc((size_t)count * max_length);
+  size_t pos = 0;
+
+  *offsets = malloc((count + 1) * sizeof(size_t));
+  srand(seed);
+  for (int i = 0; i < count; i++)
+  {
+    int length = 1 + rand() % max_length;
+    (*offsets)[i] = pos;
+    for (int j = 0; j < length; j++)
+    {
+      data[pos++] = "ab"[rand() % 2];
+    }
+  }
+  (*offsets)[count] = pos;
+  return data;
+}
+
+/* Time the table DFA and the bit-parallel NFA on the same random strings
+   over patterns of 8 to 256 positions, (a|b)*a(a|b)(a|b)... whose DFA
+   doubles with every (a|b). Reports the backend matcher_compile picks and
+   any disagreement between the two. */
+void run_backend_comparison(int count, int max_length)
+{
+  static const int sizes[] = {8, 16, 32, 64, 128, 256};
+  size_t *offsets;
+  char *data = random_ab_strings(count, max_length, 4242, &offsets);
+
+  for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+  {
+    int repeats = (sizes[i] - 3) / 2;
+    char *source = malloc(16 + 5 * repeats);
+    strcpy(source, "(a|b)*a");
+    for (int r = 0; r < repeats; r++)
+    {
+      strcat(source, "(a|b)");
+    }
+    if ((sizes[i] - 3) % 2 != 0)
+    {
+      strcat(source, "a");
+    }
+
+    char error[128];
+    Matcher matcher;
+    if (!matcher_compile(source, &matcher, error, sizeof(error)))
+    {
+      printf("Error: %s\n", error);
+      exit(1);
+    }
+    Nfa nfa;
+    Dfa dfa;
+    BitNfa bitnfa;
+    regex_parse(source, &nfa, error, sizeof(error));
+    int have_dfa = dfa_build(&nfa, &dfa, error, sizeof(error));
+    bitnfa_build(&nfa, &bitnfa, error, sizeof(error));
+    nfa_free(&nfa);
+
+    long dfa_valid = 0;
+    long dfa_elapsed = 0;
+    if (have_dfa)
+    {
+      long start = now_nanos();
+      for (int s = 0; s < count; s++)
+      {
+        dfa_valid += dfa_accepts(&dfa, data + offsets[s], offsets[s + 1] - offsets[s]);
+      }
+      dfa_elapsed = now_nanos() - start;
+    }
+    long bitnfa_valid = 0;
+    long start = now_nanos();
+    for (int s = 0; s < count; s++)
+    {
+      bitnfa_valid += bitnfa_accepts(&bitnfa, data + offsets[s], offsets[s + 1] - offsets[s]);
+    }
+    long bitnfa_elapsed = now_nanos() - start;
+    long mismatches = 0;
+    for (int s = 0; have_dfa && s < count; s++)
+    {
+      size_t length = offsets[s + 1] - offsets[s];
+      mismatches += dfa_accepts(&dfa, data + offsets[s], length) !=
+                    bitnfa_accepts(&bitnfa, data + offsets[s], length);
+    }
+
+    printf("%3d positions: picks %-6s", matcher.positions, matcher_backend_name(matcher.backend));
+    if (have_dfa)
+    {
+      printf(" dfa %4d states %.1f MB/s (%ld valid),", dfa.state_count,
+             dfa_elapsed > 0 ? offsets[count] * 1e3 / dfa_elapsed : 0.0, dfa_valid);
+    }
+    else
+    {
+      printf(" dfa over %d states,", DFA_MAX_STATES);
+    }
+    printf(" bitnfa %d words %.1f MB/s, %ld valid, %ld mismatches\n", bitnfa.words,
+           bitnfa_elapsed > 0 ? offsets[count] * 1e3 / bitnfa_elapsed : 0.0, bitnfa_valid, mismatches);
+    if (have_dfa)
+    {
+      dfa_free(&dfa);
+    }
+    bitnfa_free(&bitnfa);
+    matcher_free(&matcher);
+    free(source);
+  }
+  free(offsets);
+  free(data);
+}
+
+/* Run the lazy DFA with a cache of capacity states over random strings
+   for (a|b)*a(a|b){n-1}, whose random walk visits up to 2^n DFA states:
+   the cache holds them all for small n, is flushed now and then for n
+   around log2(capacity) and thrashes into NFA simulation beyond. Timed
+   against the table DFA (while it builds) and the bit-parallel NFA. */
+void run_lazy_comparison(int count, int capacity)
+{
+  static const int distances[] = {4, 8, 10, 12, 16, 24};
+  size_t *offsets;
+  char *data = random_ab_strings(count, 512, 4343, &offsets);
+
+  for (int i = 0; i < (int)(sizeof(distances) / sizeof(distances[0])); i++)
+  {
+    char source[256] = "(a|b)*a";
+    for (int r = 1; r < distances[i]; r++)
+    {
+      strcat(source, "(a|b)");
+    }
+
+    char error[128];
+    Nfa nfa;
+    Dfa dfa;
+    BitNfa bitnfa;
+    LazyDfa lazy;
+    regex_parse(source, &nfa, error, sizeof(error));
+    int have_dfa = dfa_build(&nfa, &dfa, error, sizeof(error));
+    if (!bitnfa_build(&nfa, &bitnfa, error, sizeof(error)))
+    {
+      printf("Error: %s\n", error);
+      exit(1);
+    }
+    lazy_dfa_init(&lazy, &nfa, capacity);
+
+    long lazy_valid = 0;
+    long mismatches = 0;
+    long start = now_nanos();
+    for (int s = 0; s < count; s++)
+    {
+      lazy_valid += lazy_dfa_accepts(&lazy, data + offsets[s], offsets[s + 1] - offsets[s]);
+    }
+    long lazy_elapsed = now_nanos() - start;
+    start = now_nanos();
+    for (int s = 0; s < count; s++)
+    {
+      mismatches += bitnfa_accepts(&bitnfa, data + offsets[s], offsets[s + 1] - offsets[s]);
+    }
+    long bitnfa_elapsed = now_nanos() - start;
+    mismatches = labs(mismatches - lazy_valid);
+    long dfa_elapsed = 0;
+    if (have_dfa)
+    {
+      long dfa_valid = 0;
+      start = now_nanos();
+      for (int s = 0; s < count; s++)
+      {
+        dfa_valid += dfa_accepts(&dfa, data + offsets[s], offsets[s + 1] - offsets[s]);
+      }
+      dfa_elapsed = now_nanos() - start;
+      mismatches += labs(dfa_valid - lazy_valid);
+    }
+    for (int s = 0; s < count && mismatches == 0; s++)
+    {
+      size_t length = offsets[s + 1] - offsets[s];
+      mismatches += lazy_dfa_accepts(&lazy, data + offsets[s], length) !=
+                    bitnfa_accepts(&bitnfa, data + offsets[s], length);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "n=%d", distances[i]);
+    printf("%s lazy %.1f MB/s,", name, lazy_elapsed > 0 ? offsets[count] * 1e3 / lazy_elapsed : 0.0);
+    if (have_dfa)
+    {
+      printf(" dfa (%d states) %.1f MB/s,", dfa.state_count,
+             dfa_elapsed > 0 ? offsets[count] * 1e3 / dfa_elapsed : 0.0);
+      dfa_free(&dfa);
+    }
+    else
+    {
+      printf(" dfa over %d states,", DFA_MAX_STATES);
+    }
+    printf(" bitnfa %.1f MB/s, %ld valid, %ld mismatches\n",
+           bitnfa_elapsed > 0 ? offsets[count] * 1e3 / bitnfa_elapsed : 0.0, lazy_valid, mismatches);
+    lazy_dfa_report(&lazy, "    cache");
+    bitnfa_free(&bitnfa);
+    lazy_dfa_free(&lazy);
+  }
+  free(offsets);
+  free(data);
+}
+
+/* Write the pattern2 DFAs and the given patterns to a cache file. */
+int run_cache_compile(const char *path, char **patterns, int count)
+{
+  const char **sources = malloc((count + 2) * sizeof(char *));
+  char error[128];
+  sources[0] = pattern2_sources[0];
+  sources[1] = pattern2_sources[1];
+  memcpy(sources + 2, patterns, count * sizeof(char *));
+  long start = now_nanos();
+  int ok = dfa_cache_write(path, sources, count + 2, error, sizeof(error));
+  long elapsed = now_nanos() - start;
+  free(sources);
+  if (!ok)
+  {
+    printf("Error: %s\n", error);
+    return 1;
+  }
+  printf("%d patterns compiled into '%s' in %.3f ms\n", count + 2, path, elapsed / 1e6);
+  return 0;
+}
+
+/* Time compiling each pattern against mapping the cache file and finding
+   it there, and check both DFAs agree on random strings. */
+int run_startup_comparison(const char *path, char **patterns, int count)
+{
+  Dfa *compiled = calloc(count, sizeof(Dfa));
+  Dfa *mapped = calloc(count, sizeof(Dfa));
+  DfaCache cache;
+  char error[128];
+  long compile_total = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    long start = now_nanos();
+    if (!dfa_compile(patterns[i], &compiled[i], error, sizeof(error)))
+    {
+      printf("Error: %s\n", error);
+      exit(1);
+    }
+    compile_total += now_nanos() - start;
+  }
+
+  long start = now_nanos();
+  if (!dfa_cache_open(path, &cache, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    exit(1);
+  }
+  int found = 0;
+  for (int i = 0; i < count; i++)
+  {
+    found += dfa_cache_find(&cache, patterns[i], &mapped[i]);
+  }
+  long map_total = now_nanos() - start;
+
+  srand(4444);
+  for (int i = 0; i < count; i++)
+  {
+    long mismatches = 0;
+    for (int s = 0; s < 10000 && mapped[i].table != NULL; s++)
+    {
+      char string[64];
+      int length = rand() % (int)sizeof(string);
+      for (int j = 0; j < length; j++)
+      {
+        string[j] = "ab"[rand() % 2];
+      }
+      mismatches += dfa_accepts(&compiled[i], string, length) != dfa_accepts(&mapped[i], string, length);
+    }
+    printf("%-40s %5d states, %s", patterns[i], compiled[i].state_count,
+           mapped[i].table != NULL ? "cached" : "not in the cache");
+    if (mapped[i].table != NULL)
+    {
+      printf(", %ld mismatches", mismatches);
+    }
+    printf("\n");
+    dfa_free(&compiled[i]);
+  }
+  printf("compile %.3f ms, map and find %d of %d %.3f ms\n", compile_total / 1e6, found, count, map_total / 1e6);
+  dfa_cache_close(&cache);
+  free(compiled);
+  free(mapped);
+  return found < count;
+}
+
+/* Differential harness.
+
+   Every engine for the pattern2 languages runs on the same inputs and
+   must agree with pattern2 itself, min_length 2 for the first language
+   and 3 for the second. The inputs sit on the language boundary: every
+   string over {a, b, c} up to FUZZ_EXHAUSTIVE_LENGTH bytes, the
+   benchmark's near-miss runs, and mutations of valid strings (a byte
+   dropped, inserted, replaced or duplicated, NUL and high bytes
+   included). A disagreement is shrunk by deleting and simplifying bytes
+   while it persists, and printed as a C string. Each engine is also
+   timed over the whole input set. */
+
+#define FUZZ_EXHAUSTIVE_LENGTH 8
+#define FUZZ_MAX_LENGTH 96
+
+static int matcher_validator(const Validator *validator, const char *string, size_t length)
+{
+  return matcher_accepts(validator->matcher, string, length);
+}
+
+/* A valid string of the first language with one random mutation. */
+static int fuzz_mutation(char *out)
+{
+  static const char bytes[] = {'a', 'b', 'c', 'A', 'B', '\0', '\n', ' ', (char)0x80, (char)0xe1, (char)0xff};
+  int as = rand() % 40;
+  int length = 0;
+  for (int j = 0; j < as; j++)
+  {
+    out[length++] = 'a';
+  }
+  out[length++] = 'b';
+  out[length++] = 'b';
+
+  int at = rand() % (length + 1);
+  char byte = rand() % 2 ? "ab"[rand() % 2] : bytes[rand() % sizeof(bytes)];
+  switch (rand() % 5)
+  {
+  case 0: /* drop */
+    if (at < length)
+    {
+      memmove(out + at, out + at + 1, length - at - 1);
+      length--;
+    }
+    break;
+  case 1: /* insert */
+    memmove(out + at + 1, out + at, length - at);
+    out[at] = byte;
+    length++;
+    break;
+  case 2: /* replace */
+    if (at < length)
+    {
+      out[at] = byte;
+    }
+    break;
+  case 3: /* truncate */
+    length = at;
+    break;
+  default: /* duplicate the tail */
+    memcpy(out + length, out + at, length - at);
+    length += length - at;
+    break;
+  }
+  return length;
+}
+
+/* Exhaustive, near-miss and mutated strings, as one buffer and offsets. */
+static char *fuzz_inputs(const Validator *reference, int count, unsigned int seed, int *total, size_t **offsets)
+{
+  int exhaustive = 0;
+  for (int length = 0, n = 1; length <= FUZZ_EXHAUSTIVE_LENGTH; length++, n *= 3)
+  {
+    exhaustive += n;
+  }
+  size_t *near_offsets;
+  char *near = generate_inputs(reference, count, FUZZ_MAX_LENGTH / 2, seed, &near_offsets);
+  *total = exhaustive + 2 * count;
+  char *data = malloc((size_t)exhaustive * FUZZ_EXHAUSTIVE_LENGTH + near_offsets[count] +
+                      (size_t)count * FUZZ_MAX_LENGTH);
+  *offsets = malloc((*total + 1) * sizeof(size_t));
+  size_t pos = 0;
+  int i = 0;
+
+  for (int length = 0, n = 1; length <= FUZZ_EXHAUSTIVE_LENGTH; length++, n *= 3)
+  {
+    for (int k = 0; k < n; k++)
+    {
+      (*offsets)[i++] = pos;
+      for (int j = 0, digits = k; j < length; j++, digits /= 3)
+      {
+        data[pos++] = "abc"[digits % 3];
+      }
+    }
+  }
+  for (int k = 0; k < count; k++)
+  {
+    (*offsets)[i++] = pos;
+    memcpy(data + pos, near + near_offsets[k], near_offsets[k + 1] - near_offsets[k]);
+    pos += near_offsets[k + 1] - near_offsets[k];
+  }
+  srand(seed);
+  for (int k = 0; k < count; k++)
+  {
+    (*offsets)[i++] = pos;
+    pos += fuzz_mutation(data + pos);
+  }
+  (*offsets)[i] = pos;
+  free(near);
+  free(near_offsets);
+  return data;
+}
+
+static int fuzz_disagrees(const Validator *engine, const Validator *reference, const char *string, size_t length)
+{
+  return engine->accepts(engine, string, length) != reference->accepts(reference, string, length);
+}
+
+/* Shrink a disagreeing string in place and return its new length. */
+static size_t fuzz_minimise(const Validator *engine, const Validator *reference, char *string, size_t length)
+{
+  int changed = 1;
+  while (changed)
+  {
+    changed = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+      char removed = string[i];
+      memmove(string + i, string + i + 1, length - i - 1);
+      if (fuzz_disagrees(engine, reference, string, length - 1))
+      {
+        length--;
+        i--;
+        changed = 1;
+        continue;
+      }
+      memmove(string + i + 1, string + i, length - i - 1);
+      string[i] = removed;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+      for (const char *simpler = "ab"; *simpler != '\0' && string[i] != *simpler; simpler++)
+      {
+        char original = string[i];
+        string[i] = *simpler;
+        if (fuzz_disagrees(engine, reference, string, length))
+        {
+          changed = 1;
+          break;
+        }
+        string[i] = original;
+      }
+    }
+  }
+  return length;
+}
+
+static void print_escaped(const char *string, size_t length)
+{
+  putchar('"');
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char c = string[i];
+    if (c == '"' || c == '\\')
+    {
+      printf("\\%c", c);
+    }
+    else if (c >= 0x20 && c < 0x7f)
+    {
+      putchar(c);
+    }
+    else
+    {
+      printf("\\x%02x", c);
+    }
+  }
+  putchar('"');
+}
+
+/* Run every pattern2 engine against pattern2 on count near-miss and count
+   mutated strings plus the exhaustive set; returns the number of engines
+   that disagreed. */
+int run_differential(int count, unsigned int seed)
+{
+  char error[128];
+  char path[] = "/tmp/patcacheXXXXXX";
+  DfaCache cache;
+  Dfa cached[2];
+  Matcher matchers[2];
+  LazyDfa small[2];
+  int fd = mkstemp(path);
+  if (fd < 0)
+  {
+    printf("Error: Could not create file '%s'\n", path);
+    return 1;
+  }
+  close(fd);
+  if (!dfa_cache_write(path, pattern2_sources, 2, error, sizeof(error)) ||
+      !dfa_cache_open(path, &cache, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    unlink(path);
+    return 1;
+  }
+  unlink(path);
+  for (int g = 0; g < 2; g++)
+  {
+    Nfa nfa;
+    if (!dfa_cache_find(&cache, pattern2_sources[g], &cached[g]) ||
+        !matcher_compile(pattern2_sources[g], &matchers[g], error, sizeof(error)) ||
+        !regex_parse(pattern2_sources[g], &nfa, error, sizeof(error)))
+    {
+      printf("Error: %s\n", error);
+      exit(1);
+    }
+    lazy_dfa_init(&small[g], &nfa, 2);
+  }
+
+  static const char *shared[2][5] = {
+      {"pattern2-first", "dfa-first", "jit-first", "bitnfa-first", "lazy-first"},
+      {"pattern2-second", "dfa-second", "jit-second", "bitnfa-second", "lazy-second"},
+  };
+  static const char *suffixes[2] = {"first", "second"};
+  char names[2][3][32];
+  Validator engines[2][8];
+  for (int g = 0; g < 2; g++)
+  {
+    for (int e = 0; e < 5; e++)
+    {
+      engines[g][e] = *find_validator(shared[g][e]);
+    }
+    snprintf(names[g][0], sizeof(names[g][0]), "cached-%s", suffixes[g]);
+    snprintf(names[g][1], sizeof(names[g][1]), "matcher-%s", suffixes[g]);
+    snprintf(names[g][2], sizeof(names[g][2]), "lazy2-%s", suffixes[g]);
+    engines[g][5] = (Validator){.name = names[g][0], .accepts = dfa_validator, .dfa = &cached[g]};
+    engines[g][6] = (Validator){.name = names[g][1], .accepts = matcher_validator, .matcher = &matchers[g]};
+    engines[g][7] = (Validator){.name = names[g][2], .accepts = lazy_validator, .lazy = &small[g]};
+  }
+
+  int total;
+  size_t *offsets;
+  char *data = fuzz_inputs(&engines[0][0], count, seed, &total, &offsets);
+  unsigned char *expected = malloc(total);
+  int failed = 0;
+  printf("%d strings, %zu bytes\n", total, offsets[total]);
+
+  /* The two references differ only where min_length does: on "bb" */
+  long differ = 0;
+  long unexpected = 0;
+  for (int i = 0; i < total; i++)
+  {
+    size_t length = offsets[i + 1] - offsets[i];
+    if (pattern2(data + offsets[i], length, 2) != pattern2(data + offsets[i], length, 3))
+    {
+      differ++;
+      unexpected += length != 2 || memcmp(data + offsets[i], "bb", 2) != 0;
+    }
+  }
+  printf("pattern2 min_length 2 and 3 differ on %ld strings, %ld other than \"bb\"\n", differ, unexpected);
+  failed += unexpected > 0;
+
+  for (int g = 0; g < 2; g++)
+  {
+    const Validator *reference = &engines[g][0];
+    for (int i = 0; i < total; i++)
+    {
+      expected[i] = reference->accepts(reference, data + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    for (int e = 0; e < 8; e++)
+    {
+      const Validator *engine = &engines[g][e];
+      long valid = 0;
+      long start = now_nanos();
+      for (int i = 0; i < total; i++)
+      {
+        valid += engine->accepts(engine, data + offsets[i], offsets[i + 1] - offsets[i]);
+      }
+      long elapsed = now_nanos() - start;
+
+      long disagreements = 0;
+      int first = -1;
+      for (int i = 0; i < total; i++)
+      {
+        if (engine->accepts(engine, data + offsets[i], offsets[i + 1] - offsets[i]) != expected[i])
+        {
+          first = disagreements++ == 0 ? i : first;
+        }
+      }
+      printf("%-16s %8.3f ms, %6.1f Mstrings/s, %7.1f MB/s, %ld valid, %ld disagreements\n", engine->name,
+             elapsed / 1e6, elapsed > 0 ? total * 1e3 / elapsed : 0.0,
+             elapsed > 0 ? offsets[total] * 1e3 / elapsed : 0.0, valid, disagreements);
+      if (first >= 0)
+      {
+        char string[2 * FUZZ_MAX_LENGTH];
+        size_t length = offsets[first + 1] - offsets[first];
+        memcpy(string, data + offsets[first], length);
+        length = fuzz_minimise(engine, reference, string, length);
+        printf("  reproducer ");
+        print_escaped(string, length);
+        printf(": %s says %d, %s says %d\n", engine->name, engine->accepts(engine, string, length),
+               reference->name, reference->accepts(reference, string, length));
+        failed++;
+      }
+    }
+  }
+
+  for (int g = 0; g < 2; g++)
+  {
+    matcher_free(&matchers[g]);
+    lazy_dfa_free(&small[g]);
+  }
+  dfa_cache_close(&cache);
+  free(expected);
+  free(offsets);
+  free(data);
+  return failed;
+}
+
+/* Substring search.
+
+   search_text reports the leftmost-longest, non-overlapping matches of a
+   pattern inside a text. Every match must contain the pattern's required
+   literal (if it has one), so the scan only looks for that literal, 16
+   bytes at a time. A match around a literal hit consists only of bytes
+   the pattern can match, which bounds how far back it can start. From
+   there an unanchored DFA (any prefix, then a non-empty match) runs
+   forward until it accepts, which is where the first match ends, or
+   falls back to its start state past the hit, when nothing is in
+   progress and the scan moves on to the next hit. Only once a match is
+   known to exist does a Pike simulation of the NFA, whose threads carry
+   their start position, pick the leftmost-longest one, starting from
+   the last point where the DFA had nothing in progress. No match starts
+   before that point, so when the anchored DFA run from it accepts where
+   the first match ends, that is the leftmost start and the anchored DFA
+   just runs on for the longest end, without the simulation.
+
+   Every byte is scanned once by the DFA and at most once by the Pike
+   simulation before the match it belongs to, so the search is linear
+   in the text apart from the lookahead past each match end that longest
+   matching needs (as in a|a*b over a run of 'a's). A pattern whose
+   unanchored DFA is too large runs on the Pike simulation alone. */
+
+#define SEARCH_MAX_LITERAL 64
+
+typedef struct
+{
+  Nfa nfa;
+  Dfa anchored;
+  Dfa forward;                   /* Unanchored, non-empty; if have_forward */
+  int have_forward;
+  unsigned char literal[SEARCH_MAX_LITERAL];
+  int literal_length;
+  unsigned char match_bytes[32]; /* Bytes any edge of the pattern accepts */
+} Searcher;
+
+/* Whether every path from start to accept passes state, found by searching
+   for a path that avoids it. */
+static int nfa_dominates(const Nfa *nfa, int state, int *stack, unsigned char *seen)
+{
+  if (state == nfa->start || state == nfa->accept)
+  {
+    return 1;
+  }
+  memset(seen, 0, nfa->count);
+  int depth = 0;
+  stack[depth++] = nfa->start;
+  seen[nfa->start] = 1;
+  seen[state] = 1;
+  while (depth > 0)
+  {
+    const NfaState *s = &nfa->states[stack[--depth]];
+    int edges[3] = {s->next, s->eps[0], s->eps[1]};
+    for (int e = 0; e < 3; e++)
+    {
+      if (edges[e] == nfa->accept)
+      {
+        return 0;
+      }
+      if (edges[e] >= 0 && !seen[edges[e]])
+      {
+        seen[edges[e]] = 1;
+        stack[depth++] = edges[e];
+      }
+    }
+  }
+  return 1;
+}
+
+/* The single byte of a byte set, or -1 if it has zero or several. */
+static int byte_set_single(const unsigned char *set)
+{
+  int byte = -1;
+  for (int b = 0; b < 256; b++)
+  {
+    if (byte_set_has(set, b))
+    {
+      if (byte >= 0)
+      {
+        return -1;
+      }
+      byte = b;
+    }
+  }
+  return byte;
+}
+
+/* Find the longest literal every match contains. States that dominate
+   the accept state and have a single-byte edge are taken in path order;
+   two of them are adjacent in every match when no byte edge is reachable
+   between the first one's edge and the second. Returns the length. */
+static int nfa_required_literal(const Nfa *nfa, unsigned char *literal, int max_length)
+{
+  int *stack = malloc(nfa->count * 3 * sizeof(int));
+  int *parent = stack + nfa->count;
+  int *path = parent + nfa->count;
+  unsigned char *seen = malloc(nfa->count);
+  int path_length = 0;
+  int best = 0;
+
+  /* One path from start to accept, by breadth-first search */
+  memset(parent, -1, nfa->count * sizeof(int));
+  int head = 0;
+  int tail = 0;
+  stack[tail++] = nfa->start;
+  parent[nfa->start] = nfa->start;
+  while (head < tail && parent[nfa->accept] < 0)
+  {
+    const NfaState *s = &nfa->states[stack[head]];
+    int edges[3] = {s->next, s->eps[0], s->eps[1]};
+    for (int e = 0; e < 3; e++)
+    {
+      if (edges[e] >= 0 && parent[edges[e]] < 0)
+      {
+        parent[edges[e]] = stack[head];
+        stack[tail++] = edges[e];
+      }
+    }
+    head++;
+  }
+  for (int s = nfa->accept; parent[s] >= 0 && s != nfa->start; s = parent[s])
+  {
+    path[path_length++] = parent[s];
+  }
+
+  /* Walk it from the start, growing runs of adjacent required bytes */
+  int run = 0;
+  int previous = -1;
+  unsigned char current[SEARCH_MAX_LITERAL];
+  for (int i = path_length - 1; i >= 0; i--)
+  {
+    int s = path[i];
+    int byte = nfa->states[s].next >= 0 ? byte_set_single(nfa->states[s].bytes) : -1;
+    if (byte < 0 || !nfa_dominates(nfa, s, stack, seen))
+    {
+      if (nfa->states[s].next >= 0)
+      {
+        run = 0; /* A byte edge that is not a required literal byte */
+      }
+      continue;
+    }
+    if (run > 0)
+    {
+      /* Adjacent when nothing between previous's edge and s consumes a byte */
+      int depth = 0;
+      int adjacent = 1;
+      memset(seen, 0, nfa->count);
+      stack[depth++] = nfa->states[previous].next;
+      seen[stack[0]] = 1;
+      seen[s] = 1;
+      while (depth > 0 && adjacent)
+      {
+        const NfaState *state = &nfa->states[stack[--depth]];
+        if (state->next >= 0)
+        {
+          adjacent = 0;
+        }
+        for (int e = 0; e < 2; e++)
+        {
+          if (state->eps[e] >= 0 && !seen[state->eps[e]])
+          {
+            seen[state->eps[e]] = 1;
+            stack[depth++] = state->eps[e];
+          }
+        }
+      }
+      if (!adjacent)
+      {
+        run = 0;
+      }
+    }
+    if (run < max_length)
+    {
+      current[run++] = byte;
+    }
+    previous = s;
+    if (run > best)
+    {
+      best = run;
+      memcpy(literal, current, run);
+    }
+  }
+  free(seen);
+  free(stack);
+  return best;
+}
+
+/* An NFA for any bytes followed by a non-empty match of nfa: states
+   0..count-1 are nfa's before any byte is read, count..2*count-1 the same
+   states after one, and the last loops on every byte in front of the
+   start. */
+static void nfa_unanchored_nonempty(const Nfa *nfa, Nfa *out)
+{
+  int count = nfa->count;
+  out->count = out->capacity = 2 * count + 1;
+  out->states = malloc(out->count * sizeof(NfaState));
+  for (int s = 0; s < count; s++)
+  {
+    const NfaState *state = &nfa->states[s];
+    for (int layer = 0; layer < 2; layer++)
+    {
+      NfaState *copy = &out->states[layer * count + s];
+      memcpy(copy->bytes, state->bytes, 32);
+      copy->next = state->next >= 0 ? count + state->next : -1;
+      for (int e = 0; e < 2; e++)
+      {
+        copy->eps[e] = state->eps[e] >= 0 ? layer * count + state->eps[e] : -1;
+      }
+    }
+  }
+  NfaState *loop = &out->states[2 * count];
+  memset(loop->bytes, 0xff, 32);
+  loop->next = 2 * count;
+  loop->eps[0] = nfa->start;
+  loop->eps[1] = -1;
+  out->start = 2 * count;
+  out->accept = count + nfa->accept;
+}
+
+/* Compile a search pattern; on failure returns 0 with a message in error. */
+int searcher_compile(const char *source, Searcher *searcher, char *error, size_t error_size)
+{
+  Nfa nfa;
+  Nfa unanchored;
+  char ignored[128];
+  memset(searcher, 0, sizeof(*searcher));
+  if (!regex_parse(source, &nfa, error, error_size))
+  {
+    return 0;
+  }
+  if (!dfa_build(&nfa, &searcher->anchored, error, error_size))
+  {
+    nfa_free(&nfa);
+    return 0;
+  }
+  nfa_unanchored_nonempty(&nfa, &unanchored);
+  searcher->have_forward = dfa_build(&unanchored, &searcher->forward, ignored, sizeof(ignored));
+  nfa_free(&unanchored);
+  memset(searcher->match_bytes, 0, sizeof(searcher->match_bytes));
+  for (int s = 0; s < nfa.count; s++)
+  {
+    if (nfa.states[s].next >= 0)
+    {
+      for (int i = 0; i < 32; i++)
+      {
+        searcher->match_bytes[i] |= nfa.states[s].bytes[i];
+      }
+    }
+  }
+  searcher->literal_length = nfa_required_literal(&nfa, searcher->literal, SEARCH_MAX_LITERAL);
+  searcher->nfa = nfa;
+  return 1;
+}
+
+void searcher_free(Searcher *searcher)
+{
+  nfa_free(&searcher->nfa);
+  dfa_free(&searcher->anchored);
+  if (searcher->have_forward)
+  {
+    dfa_free(&searcher->forward);
+  }
+}
+
+/* First occurrence of literal in text. SSE2 compares 16 candidate
+   positions against the literal's first and last bytes at once and
+   checks the middle only where both agree. */
+static const unsigned char *find_literal(const unsigned char *text, size_t length, const unsigned char *literal,
+                                         size_t literal_length)
+{
+  if (literal_length > length)
+  {
+    return NULL;
+  }
+  if (literal_length == 1)
+  {
+    return memchr(text, literal[0], length);
+  }
+  size_t last = literal_length - 1;
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i first_byte = _mm_set1_epi8((char)literal[0]);
+  __m128i last_byte = _mm_set1_epi8((char)literal[last]);
+  for (; i + last + 16 <= length; i += 16)
+  {
+    __m128i head = _mm_loadu_si128((const __m128i *)(text + i));
+    __m128i tail = _mm_loadu_si128((const __m128i *)(text + i + last));
+    unsigned int mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(head, first_byte), _mm_cmpeq_epi8(tail, last_byte)));
+    while (mask != 0)
+    {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(text + i + bit + 1, literal + 1, literal_length - 2) == 0)
+      {
+        return text + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i + literal_length <= length; i++)
+  {
+    if (text[i] == literal[0] && text[i + last] == literal[last] &&
+        memcmp(text + i + 1, literal + 1, literal_length - 2) == 0)
+    {
+      return text + i;
+    }
+  }
+  return NULL;
+}
+
+/* Pike simulation state: the start position of the thread in each NFA
+   state (-1 for none) and the list of live states, for this position and
+   the next. */
+typedef struct
+{
+  long *tags[2];
+  int *live[2];
+  int count[2];
+  int *stack;
+} PikeThreads;
+
+/* Add a thread that started at tag to state and its closure in set,
+   keeping the earlier start where two threads meet. */
+static void pike_add(const Nfa *nfa, PikeThreads *threads, int set, int state, long tag)
+{
+  long *tags = threads->tags[set];
+  int depth = 0;
+  threads->stack[depth++] = state;
+  while (depth > 0)
+  {
+    int s = threads->stack[--depth];
+    if (tags[s] >= 0 && tags[s] <= tag)
+    {
+      continue;
+    }
+    if (tags[s] < 0)
+    {
+      threads->live[set][threads->count[set]++] = s;
+    }
+    tags[s] = tag;
+    for (int e = 0; e < 2; e++)
+    {
+      if (nfa->states[s].eps[e] >= 0)
+      {
+        threads->stack[depth++] = nfa->states[s].eps[e];
+      }
+    }
+  }
+}
+
+static void pike_clear(PikeThreads *threads, int set)
+{
+  for (int i = 0; i < threads->count[set]; i++)
+  {
+    threads->tags[set][threads->live[set][i]] = -1;
+  }
+  threads->count[set] = 0;
+}
+
+/* Find the leftmost-longest non-empty match starting at or after from. A
+   new thread starts at every position until some thread accepts; after
+   that only threads that started no later than the best start so far
+   can change the answer, and the simulation runs until none is left.
+   Returns 1 with the match in *start and *end. Without a match, returns
+   0 with *end at the first position past boundary where no thread is
+   alive (no later match starts before it) or at the end of the text. */
+static int pike_match(const Nfa *nfa, PikeThreads *threads, const unsigned char *text, size_t length, size_t from,
+                      size_t boundary, size_t *start, size_t *end)
+{
+  long best = -1;
+  size_t best_end = 0;
+  size_t p = from;
+  int current = 0;
+
+  pike_clear(threads, 0);
+  pike_clear(threads, 1);
+  for (;;)
+  {
+    if (best < 0)
+    {
+      pike_add(nfa, threads, current, nfa->start, p);
+    }
+    long tag = threads->tags[current][nfa->accept];
+    if (tag >= 0 && tag < (long)p && (best < 0 || tag <= best))
+    {
+      best = tag;
+      best_end = p;
+    }
+    if (p == length)
+    {
+      break;
+    }
+
+    int next = 1 - current;
+    pike_clear(threads, next);
+    for (int i = 0; i < threads->count[current]; i++)
+    {
+      int s = threads->live[current][i];
+      long t = threads->tags[current][s];
+      const NfaState *state = &nfa->states[s];
+      if (state->next >= 0 && (best < 0 || t <= best) && byte_set_has(state->bytes, text[p]))
+      {
+        pike_add(nfa, threads, next, state->next, t);
+      }
+    }
+    current = next;
+    p++;
+    if (threads->count[current] == 0 && (best >= 0 || p > boundary))
+    {
+      break;
+    }
+  }
+  if (best >= 0)
+  {
+    *start = best;
+    *end = best_end;
+    return 1;
+  }
+  *end = p;
+  return 0;
+}
+
+/* Run the unanchored DFA from from (where nothing is in progress). Returns
+   1 with *end just past the first byte where it accepts, which ends some
+   match, and *idle at the last position before that where it was back
+   in its start state. Returns 0 with *end at the first position past
+   boundary where it is back in its start state, or at the end of the
+   text. */
+static int forward_scan(const Dfa *dfa, const unsigned char *text, size_t length, size_t from, size_t boundary,
+                        size_t *idle, size_t *end)
+{
+  const unsigned short *table = dfa->table;
+  int classes = dfa->class_count;
+  unsigned int state = 1;
+
+  *idle = from;
+  for (size_t p = from; p < length; p++)
+  {
+    state = table[state * classes + dfa->byte_class[text[p]]];
+    if (state == 1)
+    {
+      *idle = p + 1;
+      if (p >= boundary)
+      {
+        *end = p + 1;
+        return 0;
+      }
+    }
+    else if (dfa->accepting[state])
+    {
+      *end = p + 1;
+      return 1;
+    }
+  }
+  *end = length;
+  return 0;
+}
+
+/* The end of the longest match starting at from, if the anchored DFA is
+   in an accepting state at first_end (no match ends earlier), else 0. */
+static size_t anchored_match(const Dfa *dfa, const unsigned char *text, size_t length, size_t from,
+                             size_t first_end)
+{
+  const unsigned short *table = dfa->table;
+  int classes = dfa->class_count;
+  unsigned int state = 1;
+  size_t p = from;
+
+  while (p < first_end && state != DFA_DEAD)
+  {
+    state = table[state * classes + dfa->byte_class[text[p++]]];
+  }
+  if (state == DFA_DEAD || !dfa->accepting[state])
+  {
+    return 0;
+  }
+  size_t end = p;
+  while (p < length)
+  {
+    state = table[state * classes + dfa->byte_class[text[p++]]];
+    if (state == DFA_DEAD)
+    {
+      break;
+    }
+    if (dfa->accepting[state])
+    {
+      end = p;
+    }
+  }
+  return end;
+}
+
+/* Report every non-empty leftmost-longest match of the searcher in text
+   to visit; returns the number of matches. */
+long search_text(const Searcher *searcher, const unsigned char *text, size_t length,
+                 void (*visit)(size_t offset, size_t length, void *ctx), void *ctx)
+{
+  const Nfa *nfa = &searcher->nfa;
+  PikeThreads threads;
+  long matches = 0;
+  size_t floor = 0; /* No further match starts before floor */
+
+  for (int set = 0; set < 2; set++)
+  {
+    threads.tags[set] = malloc(nfa->count * sizeof(long));
+    threads.live[set] = malloc(nfa->count * sizeof(int));
+    threads.count[set] = 0;
+    memset(threads.tags[set], -1, nfa->count * sizeof(long));
+  }
+  /* Each closure pushes a state at most once per outgoing edge */
+  threads.stack = malloc(2 * nfa->count * sizeof(int) + sizeof(int));
+
+  while (floor < length)
+  {
+    size_t from = floor;
+    size_t boundary = length;
+    if (searcher->literal_length > 0)
+    {
+      const unsigned char *hit =
+          find_literal(text + floor, length - floor, searcher->literal, searcher->literal_length);
+      if (hit == NULL)
+      {
+        break;
+      }
+      boundary = hit - text;
+      from = boundary;
+      while (from > floor && byte_set_has(searcher->match_bytes, text[from - 1]))
+      {
+        from--;
+      }
+    }
+
+    size_t start;
+    size_t end;
+    if (searcher->have_forward)
+    {
+      size_t idle;
+      if (!forward_scan(&searcher->forward, text, length, from, boundary, &idle, &end))
+      {
+        floor = end;
+        continue;
+      }
+      from = idle;
+      boundary = length;
+      if (end > from && (end = anchored_match(&searcher->anchored, text, length, from, end)) > 0)
+      {
+        visit(from, end - from, ctx);
+        matches++;
+        floor = end;
+        continue;
+      }
+    }
+    if (pike_match(nfa, &threads, text, length, from, boundary, &start, &end))
+    {
+      visit(start, end - start, ctx);
+      matches++;
+    }
+    floor = end;
+  }
+
+  for (int set = 0; set < 2; set++)
+  {
+    free(threads.tags[set]);
+    free(threads.live[set]);
+  }
+  free(threads.stack);
+  return matches;
+}
+
+static void print_match(size_t offset, size_t length, void *ctx)
+{
+  (void)ctx;
+  printf("%zu %zu\n", offset, length);
+}
+
+static void count_match(size_t offset, size_t length, void *ctx)
+{
+  (void)offset;
+  *(size_t *)ctx += length;
+}
+
+/* Search a memory-mapped file for pattern and print the offset and length
+   of every match (only the totals when quiet). */
+int run_search(const char *pattern, const char *path, int quiet)
+{
+  Searcher searcher;
+  char error[128];
+  if (!searcher_compile(pattern, &searcher, error, sizeof(error)))
+  {
+    printf("Error: %s\n", error);
+    return 1;
+  }
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    printf("Error: Could not open file '%s'\n", path);
+    return 1;
+  }
+  const unsigned char *text = NULL;
+  if (st.st_size > 0)
+  {
+    text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED)
+    {
+      printf("Error: Could not map file '%s'\n", path);
+      close(fd);
+      return 1;
+    }
+    madvise((void *)text, st.st_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  size_t matched = 0;
+  long start = now_nanos();
+  long matches = text != NULL ? search_text(&searcher, text, st.st_size, quiet ? count_match : print_match,
+                                            &matched)
+                              : 0;
+  long elapsed = now_nanos() - start;
+  printf("%ld matches", matches);
+  if (quiet)
+  {
+    printf(" (%zu bytes)", matched);
+  }
+  printf(" in %lld bytes, %.3f ms, %.2f GB/s; required literal \"%.*s\"\n", (long long)st.st_size,
+         elapsed / 1e6, elapsed > 0 ? st.st_size / (double)elapsed : 0.0, searcher.literal_length,
+         (const char *)searcher.literal);
+  if (text != NULL)
+  {
+    munmap((void *)text, st.st_size);
+  }
+  searcher_free(&searcher);
+  return 0;
+}
+
+/* Validation service over a Unix socket.
+
+   Each request is a length-prefixed frame:
+     u32 payload length, then the payload:
+     u8 validator name length, validator name,
+     u32 string count, and count times (u32 length, bytes).
+   Each response frame is:
+     u32 string count, then a bitmap of (count + 7) / 8 bytes with bit i
+     (LSB first) set when string i is valid. A count of 0xffffffff means
+     the request was rejected.
+   All integers are in network byte order. One connection can send any
+   number of requests; every connection is served by its own thread. A
+   client that goes away mid-reply only ends its own connection: SIGPIPE
+   is ignored and the failed write closes it. */
+
+#define SERVICE_MAX_FRAME (64u << 20)
+#define SERVICE_REJECTED 0xffffffffu
+
+static int read_full(int fd, void *buffer, size_t length)
+{
+  char *p = buffer;
+  while (length > 0)
+  {
+    ssize_t n = read(fd, p, length);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return 0;
+    }
+    p += n;
+    length -= n;
+  }
+  return 1;
+}
+
+static int write_full(int fd, const void *buffer, size_t length)
+{
+  const char *p = buffer;
+  while (length > 0)
+  {
+    ssize_t n = write(fd, p, length);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return 0;
+    }
+    p += n;
+    length -= n;
+  }
+  return 1;
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+  unsigned int v;
+  memcpy(&v, p, 4);
+  return ntohl(v);
+}
+
+static void put_u32(unsigned char *p, unsigned int value)
+{
+  unsigned int v = htonl(value);
+  memcpy(p, &v, 4);
+}
+
+/* Evaluate one request payload into response (header + bitmap); returns the
+   response length. */
+static size_t evaluate_batch(const unsigned char *payload, size_t length, unsigned char **response,
+                             size_t *response_capacity)
+{
+  char name[256];
+  const Validator *validator = NULL;
+  unsigned int count = SERVICE_REJECTED;
+  size_t pos = 0;
+
+  if (length >= 1 && length >= 1 + (size_t)payload[0] + 4)
+  {
+    memcpy(name, payload + 1, payload[0]);
+    name[payload[0]] = '\0';
+    validator = find_validator(name);
+    pos = 1 + payload[0];
+    count = get_u32(payload + pos);
+    pos += 4;
+  }
+  /* Every string needs at least its length prefix, so a larger count
+     cannot be honest; check before sizing the bitmap from it */
+  if (validator == NULL || count > (length - pos) / 4)
+  {
+    count = SERVICE_REJECTED;
+  }
+
+  size_t bitmap_bytes = count == SERVICE_REJECTED ? 0 : (count + 7) / 8;
+  if (4 + bitmap_bytes > *response_capacity)
+  {
+    *response_capacity = 4 + bitmap_bytes;
+    *response = realloc(*response, *response_capacity);
+  }
+  unsigned char *bitmap = *response + 4;
+  memset(bitmap, 0, bitmap_bytes);
+
+  for (unsigned int i = 0; count != SERVICE_REJECTED && i < count; i++)
+  {
+    if (pos + 4 > length || get_u32(payload + pos) > length - pos - 4)
+    {
+      count = SERVICE_REJECTED;
+      bitmap_bytes = 0;
+      break;
+    }
+    unsigned int string_length = get_u32(payload + pos);
+    if (validator->accepts(validator, (const char *)payload + pos + 4, string_length))
+    {
+      bitmap[i / 8] |= 1 << (i % 8);
+    }
+    pos += 4 + string_length;
+  }
+  put_u32(*response, count);
+  return 4 + bitmap_bytes;
+}
+
+static void *serve_connection(void *arg)
+{
+  int fd = (int)(long)arg;
+  unsigned char *payload = NULL;
+  size_t payload_capacity = 0;
+  unsigned char *response = NULL;
+  size_t response_capacity = 0;
+  unsigned char header[4];
+
+  while (read_full(fd, header, 4))
+  {
+    unsigned int length = get_u32(header);
+    if (length > SERVICE_MAX_FRAME)
+    {
+      break;
+    }
+    if (length > payload_capacity)
+    {
+      payload_capacity = length;
+      payload = realloc(payload, payload_capacity);
+    }
+    if (!read_full(fd, payload, length))
+    {
+      break;
+    }
+    size_t n = evaluate_batch(payload, length, &response, &response_capacity);
+    if (!write_full(fd, response, n))
+    {
+      break;
+    }
+  }
+  free(payload);
+  free(response);
+  close(fd);
+  return NULL;
+}
+
+static int unix_socket_address(const char *path, struct sockaddr_un *address)
+{
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path))
+  {
+    printf("Error: Socket path too long '%s'\n", path);
+    return 0;
+  }
+  strcpy(address->sun_path, path);
+  return 1;
+}
+
+/* Accept connections forever, one detached thread per connection. */
+int run_service(const char *path)
+{
+  struct sockaddr_un address;
+  if (!unix_socket_address(path, &address))
+  {
+    return 1;
+  }
+  /* Only a stale socket is replaced; any other file at the path is kept */
+  struct stat existing;
+  if (lstat(path, &existing) == 0)
+  {
+    if (!S_ISSOCK(existing.st_mode))
+    {
+      printf("Error: Could not listen on '%s': %s\n", path, strerror(EADDRINUSE));
+      return 1;
+    }
+    unlink(path);
+  }
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 64) != 0)
+  {
+    printf("Error: Could not listen on '%s': %s\n", path, strerror(errno));
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  printf("Serving validators on %s\n", path);
+  fflush(stdout);
+
+  for (;;)
+  {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      printf("Error: accept failed: %s\n", strerror(errno));
+      return 1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve_connection, (void *)(long)fd) != 0)
+    {
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
+
+/* Load generator: clients send pre-built batch frames back to back and
+   record the latency of each round trip. */
+
+typedef struct
+{
+  const char *path;
+  const unsigned char *frame;
+  size_t frame_length;
+  const unsigned char *expected;
+  unsigned int batch_size;
+  int batches;
+  long *latencies;
+  int mismatches;
+  int rejected;
+  int failed;
+} LoadClient;
+
+static void *load_client(void *arg)
+{
+  LoadClient *client = arg;
+  struct sockaddr_un address;
+  size_t response_length = 4 + (client->batch_size + 7) / 8;
+  unsigned char *response = malloc(response_length);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0 || !unix_socket_address(client->path, &address) ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+  {
+    client->failed = 1;
+    free(response);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return NULL;
+  }
+  for (int b = 0; b < client->batches; b++)
+  {
+    long start = now_nanos();
+    if (!write_full(fd, client->frame, client->frame_length) || !read_full(fd, response, 4))
+    {
+      client->failed = 1;
+      break;
+    }
+    /* A rejection is only the 4-byte header; the same frame would be
+       rejected again */
+    if (get_u32(response) == SERVICE_REJECTED)
+    {
+      client->rejected = 1;
+      break;
+    }
+    if (get_u32(response) != client->batch_size || !read_full(fd, response + 4, response_length - 4))
+    {
+      client->failed = 1;
+      break;
+    }
+    client->latencies[b] = now_nanos() - start;
+    if (memcmp(response + 4, client->expected, response_length - 4) != 0)
+    {
+      client->mismatches++;
+    }
+  }
+  close(fd);
+  free(response);
+  return NULL;
+}
+
+static int compare_longs(const void *a, const void *b)
+{
+  long x = *(const long *)a;
+  long y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+/* Drive a running service with clients concurrent connections, each sending
+   batches requests of batch_size generated strings, and report throughput and
+   latency percentiles. Responses are checked against the local validator. */
+int run_load_generator(const char *path, const Validator *validator, int clients, int batches,
+                       unsigned int batch_size, int max_length)
+{
+  size_t *offsets;
+  char *data = generate_inputs(validator, batch_size, max_length, 4242, &offsets);
+  size_t name_length = strlen(validator->name);
+  size_t payload_length = 1 + name_length + 4 + 4 * (size_t)batch_size + offsets[batch_size];
+  unsigned char *frame = malloc(4 + payload_length);
+  unsigned char *expected = calloc((batch_size + 7) / 8 + 1, 1);
+  size_t pos = 4;
+
+  put_u32(frame, payload_length);
+  frame[pos++] = name_length;
+  memcpy(frame + pos, validator->name, name_length);
+  pos += name_length;
+  put_u32(frame + pos, batch_size);
+  pos += 4;
+  for (unsigned int i = 0; i < batch_size; i++)
+  {
+    size_t length = offsets[i + 1] - offsets[i];
+    put_u32(frame + pos, length);
+    memcpy(frame + pos + 4, data + offsets[i], length);
+    pos += 4 + length;
+    if (validator->accepts(validator, data + offsets[i], length))
+    {
+      expected[i / 8] |= 1 << (i % 8);
+    }
+  }
+
+  LoadClient *load = calloc(clients, sizeof(LoadClient));
+  pthread_t *threads = malloc(clients * sizeof(pthread_t));
+  signal(SIGPIPE, SIG_IGN);
+  long start = now_nanos();
+  for (int c = 0; c < clients; c++)
+  {
+    load[c].path = path;
+    load[c].frame = frame;
+    load[c].frame_length = 4 + payload_length;
+    load[c].expected = expected;
+    load[c].batch_size = batch_size;
+    load[c].batches = batches;
+    load[c].latencies = calloc(batches, sizeof(long));
+    pthread_create(&threads[c], NULL, load_client, &load[c]);
+  }
+  for (int c = 0; c < clients; c++)
+  {
+    pthread_join(threads[c], NULL);
+  }
+  long elapsed = now_nanos() - start;
+
+  long *all = malloc((size_t)clients * batches * sizeof(long));
+  int completed = 0;
+  int mismatches = 0;
+  int rejected = 0;
+  int failed = 0;
+  for (int c = 0; c < clients; c++)
+  {
+    for (int b = 0; b < batches && load[c].latencies[b] > 0; b++)
+    {
+      all[completed++] = load[c].latencies[b];
+    }
+    mismatches += load[c].mismatches;
+    rejected += load[c].rejected;
+    failed += load[c].failed;
+    free(load[c].latencies);
+  }
+  qsort(all, completed, sizeof(long), compare_longs);
+
+  printf("%s: %d clients x %d batches of %u strings, %d batches completed, %d failed clients, "
+         "%d rejected clients, %d mismatches\n",
+         validator->name, clients, batches, batch_size, completed, failed, rejected, mismatches);
+  if (completed > 0)
+  {
+    printf("throughput %.1f Mstrings/s, %.1f batches/s; latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           (double)completed * batch_size * 1e3 / elapsed, completed * 1e9 / elapsed,
+           all[completed / 2] / 1e3, all[(completed * 99) / 100 < completed ? (completed * 99) / 100 : completed - 1] / 1e3,
+           all[completed - 1] / 1e3);
+  }
+
+  free(all);
+  free(threads);
+  free(load);
+  free(expected);
+  free(frame);
+  free(offsets);
+  free(data);
+  return failed > 0 || rejected > 0 || mismatches > 0;
+}
+
+static void usage(const char *prog)
+{
+  printf("Usage: %s [--cache FILE] <validator> [--batch FILE | --stream | --bench N [MAXLEN]]\n", prog);
+  printf("       %s serve SOCKET\n", prog);
+  printf("       %s loadgen SOCKET <validator> [CLIENTS BATCHES BATCH_SIZE [MAXLEN]]\n", prog);
+  printf("       %s engines N [MAXLEN]\n", prog);
+  printf("       %s backends N [MAXLEN]\n", prog);
+  printf("       %s lazy N [STATES]\n", prog);
+  printf("       %s search PATTERN FILE [--count]\n", prog);
+  printf("       %s compile FILE [PATTERN...]\n", prog);
+  printf("       %s startup FILE PATTERN...\n", prog);
+  printf("       %s fuzz N [SEED]\n", prog);
+  printf("Validators:\n");
+  for (int i = 0; i < VALIDATOR_COUNT; i++)
+  {
+    printf("  %-16s %s\n", validators[i].name, validators[i].description);
+  }
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  static DfaCache cache;
+  const DfaCache *dfas = NULL;
+  if (argc >= 3 && strcmp(argv[1], "--cache") == 0)
+  {
+    char error[128];
+    if (!dfa_cache_open(argv[2], &cache, error, sizeof(error)))
+    {
+      printf("Error: %s\n", error);
+      return 1;
+    }
+    dfas = &cache;
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+
+  init_automata();
+  init_pattern_dfas(dfas);
+  if (argc < 2)
+  {
+    usage(argv[0]);
+  }
+
+  if (strcmp(argv[1], "serve") == 0 && argc == 3)
+  {
+    return run_service(argv[2]);
+  }
+  if (strcmp(argv[1], "loadgen") == 0 && (argc == 4 || argc == 7 || argc == 8))
+  {
+    const Validator *target = find_validator(argv[3]);
+    if (target == NULL)
+    {
+      usage(argv[0]);
+    }
+    int clients = argc >= 7 ? atoi(argv[4]) : 4;
+    int batches = argc >= 7 ? atoi(argv[5]) : 1000;
+    int batch_size = argc >= 7 ? atoi(argv[6]) : 256;
+    if (clients < 1 || batches < 1 || batch_size < 1)
+    {
+      usage(argv[0]);
+    }
+    return run_load_generator(argv[2], target, clients, batches, batch_size, argc == 8 ? atoi(argv[7]) : 64);
+  }
+
+  if (strcmp(argv[1], "engines") == 0 && (argc == 3 || argc == 4))
+  {
+    run_engine_comparison(atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 64);
+    return 0;
+  }
+  if (strcmp(argv[1], "backends") == 0 && (argc == 3 || argc == 4))
+  {
+    run_backend_comparison(atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 512);
+    return 0;
+  }
+  if (strcmp(argv[1], "lazy") == 0 && (argc == 3 || argc == 4))
+  {
+    run_lazy_comparison(atoi(argv[2]), argc == 4 ? atoi(argv[3]) : MATCHER_LAZY_STATES);
+    return 0;
+  }
+
+  if (strcmp(argv[1], "search") == 0 && (argc == 4 || (argc == 5 && strcmp(argv[4], "--count") == 0)))
+  {
+    return run_search(argv[2], argv[3], argc == 5);
+  }
+  if (strcmp(argv[1], "compile") == 0 && argc >= 3)
+  {
+    return run_cache_compile(argv[2], argv + 3, argc - 3);
+  }
+  if (strcmp(argv[1], "startup") == 0 && argc >= 4)
+  {
+    return run_startup_comparison(argv[2], argv + 3, argc - 3);
+  }
+  if (strcmp(argv[1], "fuzz") == 0 && (argc == 3 || argc == 4))
+  {
+    return run_differential(atoi(argv[2]), argc == 4 ? strtoul(argv[3], NULL, 10) : 1) > 0;
+  }
+
+  const Validator *validator = find_validator(argv[1]);
+  if (validator == NULL)
+  {
+    usage(argv[0]);
+  }
+
+  if (argc == 2)
+  {
+    run_interactive(validator);
+  }
+  else if (strcmp(argv[2], "--batch") == 0 && argc == 4)
+  {
+    FILE *in = fopen(argv[3], "r");
+    if (in == NULL)
+    {
+      printf("Error: Could not open file '%s'\n", argv[3]);
+      return 1;
+    }
+    run_stream(validator, in, 0);
+    fclose(in);
+  }
+  else if (strcmp(argv[2], "--stream") == 0 && argc == 3)
+  {
+    run_stream(validator, stdin, 0);
+  }
+  else if (strcmp(argv[2], "--bench") == 0 && (argc == 4 || argc == 5))
+  {
+    run_benchmark(validator, atoi(argv[3]), argc == 5 ? atoi(argv[4]) : 64);
+  }
+  else
+  {
+    usage(argv[0]);
+  }
+
+  return 0;
+}